@@ -0,0 +1,120 @@
+/**
+ *  @file msp430x20x2.h
+ *  @brief Host replacement of the IAR device header, used by rfsim
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details This header is found before the IAR one only when the firmware
+ *  is compiled on the PC inside rfsim (see rfsim.c).
+ *  The peripheral registers are plain variables owned by the simulator,
+ *  the intrinsics are routed to simulator functions : entering a low power
+ *  mode is what lets the simulated time advance.
+ *  Only what is used by rf_motor.c is defined.
+ */
+#ifndef MSP430X20X2_H
+#define MSP430X20X2_H
+
+/*
+ *  Compiler extensions
+ */
+#define __interrupt
+
+/*
+ *  Bits
+ */
+#define BIT0   0x01
+#define BIT1   0x02
+#define BIT2   0x04
+#define BIT3   0x08
+#define BIT4   0x10
+#define BIT5   0x20
+#define BIT6   0x40
+#define BIT7   0x80
+
+/*
+ *  Status register
+ */
+#define GIE        0x0008
+#define CPUOFF     0x0010
+#define OSCOFF     0x0020
+#define SCG0       0x0040
+#define SCG1       0x0080
+#define LPM0_bits  (CPUOFF)
+
+extern unsigned short SimSR;
+extern unsigned short SimSRIrq;      /* SR saved at the interrupt entry */
+void SimBisSr(unsigned short bits);
+void SimIdle(void);
+
+typedef unsigned short istate_t;
+
+#define _BIS_SR(x)                  SimBisSr(x)
+#define _BIC_SR(x)                  (SimSR &= ~(x))
+#define _BIC_SR_IRQ(x)              (SimSRIrq &= ~(x))
+#define __bis_SR_register(x)        SimBisSr(x)
+#define __low_power_mode_0()        SimIdle()
+#define __bic_SR_register(x)        (SimSR &= ~(x))
+#define __enable_interrupt()        SimBisSr(GIE)
+#define __disable_interrupt()       (SimSR &= ~GIE)
+#define __get_interrupt_state()     (SimSR)
+#define __set_interrupt_state(x)    (SimSR = (x))
+#define __delay_cycles(x)           ((void) 0)
+
+/*
+ *  Watchdog
+ */
+extern unsigned short WDTCTL;
+#define WDTPW      0x5A00
+#define WDTHOLD    0x0080
+
+/*
+ *  Basic clock
+ */
+extern unsigned char DCOCTL, BCSCTL1, BCSCTL2;
+#define CALDCO_16MHZ  0x95
+#define CALBC1_16MHZ  0x8F
+#define CALDCO_1MHZ   0xB8
+#define CALBC1_1MHZ   0x86
+#define DIVS_3        0x06
+
+/*
+ *  Ports
+ */
+extern unsigned char P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1REN;
+extern unsigned char P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2REN;
+
+/*
+ *  Timer_A2
+ */
+extern unsigned short TACTL, TAR, TACCTL0, TACCTL1, TACCR0, TACCR1, TAIV;
+#define CCTL0      TACCTL0
+#define CCTL1      TACCTL1
+#define CCR0       TACCR0
+#define CCR1       TACCR1
+
+#define TASSEL_2   0x0200
+#define ID_3       0x00C0
+#define MC_1       0x0010
+#define MC_2       0x0020
+#define TACLR      0x0004
+#define TAIE       0x0002
+#define TAIFG      0x0001
+
+#define CM_1       0x4000
+#define CM_2       0x8000
+#define CM_3       0xC000
+#define CCIS_0     0x0000
+#define CCIS_1     0x1000
+#define SCS        0x0800
+#define CAP        0x0100
+#define OUTMOD_0   0x0000
+#define OUTMOD_1   0x0020
+#define OUTMOD_4   0x0080
+#define OUTMOD_5   0x00A0
+#define OUTMOD_7   0x00E0
+#define CCIE       0x0010
+#define CCI        0x0008
+#define OUT        0x0004
+#define COV        0x0002
+#define CCIFG      0x0001
+
+#endif
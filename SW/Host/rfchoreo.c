@@ -0,0 +1,618 @@
+/**
+ *  @file rfchoreo.c
+ *  @brief Choreography compiler - keyframes to motion script
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details Read a keyframe file and write the motion script run by
+ *  rf_motor.c (byte code in ../RangeFinderServo/rf_script.h) as a C file,
+ *  to be included by the firmware defining RF_SCRIPT_FILE.
+ *
+ *  rfchoreo [-c min_us:max_us:degrees] [-b bytes] [-p ms] [-r deg_per_s]
+ *           <in.txt> <out.h>
+ *
+ *  Keyframe file, one keyframe or command per line, # for comments :
+ *
+ *     <time_ms> <angle> [linear|in|out|inout]
+ *        The arm is at angle (degrees) at time_ms. The easing shapes the
+ *        movement from the previous keyframe (default linear).
+ *        The first keyframe must be at time 0, the arm goes there as fast
+ *        as possible.
+ *     waitrf
+ *        Wait for the remote, the times of the next keyframes count from
+ *        the remote command.
+ *     loop
+ *        At the end, run again from the first keyframe (last line only).
+ *
+ *  The angle becomes a pulse width through the servo calibration (-c, by
+ *  default 380 to 2320 uSec for 0 to 180 degrees), then a Pwm1_dc value
+ *  (.01 ms steps). The easings are split in linear pieces, every piece is
+ *  converted in moves at two adjacent speeds (ms per step), and a wait if
+ *  it is slower than the slowest speed, so it ends on time, then the moves
+ *  at the same speed and direction are merged, and the moves at the speed of the previous one are written
+ *  as OP_SLIDE (delta of the target, one byte less).
+ *  The script must fit in -b bytes (default SCRIPT_MAXSIZE).
+ *
+ *  The result is checked running the script as the firmware does, through
+ *  a servo model turning at most -r degrees per second (default 400, about
+ *  .15 s for 60 degrees). The maximum error against the keyframes is
+ *  printed, -p prints also the position every ms milliseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../RangeFinderServo/rf_script.h"
+
+#define MAXKEYS     256
+#define EASEPIECES  8           /* Linear pieces for an easing */
+#define MAXOPS      1024
+
+enum { EASE_LINEAR, EASE_IN, EASE_OUT, EASE_INOUT };
+
+typedef struct
+{
+   unsigned long time;          /* ms from the start (waitrf = no time) */
+   double        angle;
+   int           ease;
+   int           waitrf;        /* Remote waited before this keyframe */
+} keyframe;
+
+typedef struct
+{
+   unsigned char op;
+   unsigned char target;        /* OP_MOVE */
+   unsigned char speed;         /* OP_MOVE - ms per step */
+   signed char   dir;           /* OP_MOVE - 1 up, -1 down */
+   unsigned char time;          /* OP_WAIT - 10 ms units */
+} scriptop;
+
+static keyframe Keys[MAXKEYS];
+static int      NKeys;
+static int      Loop;
+
+static scriptop Ops[MAXOPS];
+static int      NOps;
+
+static double   MinUs = 380, MaxUs = 2320, Degrees = 180;
+
+static int usage(void)
+{
+   fprintf(stderr,
+           "usage: rfchoreo [-c min_us:max_us:degrees] [-b bytes] [-p ms]\n"
+           "                [-r deg_per_s] <in.txt> <out.h>\n");
+   return(1);
+}
+
+/*
+ *  Servo calibration
+ */
+static int angle2dc(double angle)
+{
+   double us = MinUs + (MaxUs - MinUs) * angle / Degrees;
+   int dc = (int) floor(us / 10 + 0.5);
+
+   return(dc < 0 ? 0 : dc > 255 ? 255 : dc);
+}
+
+static double dc2angle(int dc)
+{
+   return((dc * 10 - MinUs) * Degrees / (MaxUs - MinUs));
+}
+
+static double ease(int type, double f)
+{
+   switch(type)
+   {
+      case EASE_IN:
+         return(f * f);
+      case EASE_OUT:
+         return(f * (2 - f));
+      case EASE_INOUT:
+         return(f < 0.5 ? 2 * f * f : -1 + (4 - 2 * f) * f);
+   }
+   return(f);
+}
+
+/*
+ *  Keyframe file
+ */
+static int readkeys(const char *name)
+{
+   char line[128], how[16];
+   unsigned long base = 0;
+   unsigned long t;
+   double angle;
+   int waitrf = 0;                  /* Line of a waitrf without keyframe */
+   int lineno = 0;
+   int n;
+   FILE *fp;
+
+   fp = fopen(name, "r");
+   if(!fp)
+   {
+      perror(name);
+      return(-1);
+   }
+
+   while(fgets(line, sizeof(line), fp))
+   {
+      lineno++;
+      if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+         continue;
+
+      if(Loop)
+         goto bad;                  /* loop must be the last line */
+
+      if(!strncmp(line, "waitrf", 6))
+      {
+         if(!NKeys || waitrf)
+            goto bad;
+         base   = Keys[NKeys - 1].time;
+         waitrf = lineno;
+         continue;
+      }
+      if(!strncmp(line, "loop", 4))
+      {
+         if(!NKeys || waitrf)
+            goto bad;
+         Loop = 1;
+         continue;
+      }
+
+      n = sscanf(line, "%lu %lf %15s", &t, &angle, how);
+      if(n < 2 || NKeys == MAXKEYS || angle < 0 || angle > Degrees)
+         goto bad;
+
+      Keys[NKeys].ease = EASE_LINEAR;
+      if(n == 3)
+      {
+         if(!strcmp(how, "in"))
+            Keys[NKeys].ease = EASE_IN;
+         else if(!strcmp(how, "out"))
+            Keys[NKeys].ease = EASE_OUT;
+         else if(!strcmp(how, "inout"))
+            Keys[NKeys].ease = EASE_INOUT;
+         else if(strcmp(how, "linear"))
+            goto bad;
+      }
+
+      Keys[NKeys].time   = base + t;
+      Keys[NKeys].angle  = angle;
+      Keys[NKeys].waitrf = waitrf != 0;
+      if(NKeys ? Keys[NKeys].time < Keys[NKeys - 1].time : t != 0)
+         goto bad;
+      waitrf = 0;
+      NKeys++;
+   }
+
+   if(waitrf)
+   {
+      lineno = waitrf;              /* Nothing to wait the remote for */
+      goto bad;
+   }
+
+   fclose(fp);
+   if(!NKeys)
+   {
+      fprintf(stderr, "rfchoreo: %s: no keyframes\n", name);
+      return(-1);
+   }
+   return(0);
+
+bad:
+   fprintf(stderr, "rfchoreo: %s:%d: invalid line\n", name, lineno);
+   fclose(fp);
+   return(-1);
+}
+
+/*
+ *  Script building
+ */
+static int addop(unsigned char op, unsigned char target,
+                 unsigned char speed, unsigned char time)
+{
+   scriptop *prev = NOps ? &Ops[NOps - 1] : NULL;
+
+   if(prev && op == OP_WAIT && prev->op == OP_WAIT &&
+      prev->time + time <= 255)
+   {
+      prev->time += time;           /* Merge the waits */
+      return(0);
+   }
+
+   if(NOps == MAXOPS)
+   {
+      fprintf(stderr, "rfchoreo: too many operations\n");
+      return(-1);
+   }
+   Ops[NOps].op     = op;
+   Ops[NOps].target = target;
+   Ops[NOps].speed  = speed;
+   Ops[NOps].time   = time;
+   Ops[NOps].dir    = 0;
+   NOps++;
+   return(0);
+}
+
+/*
+ *  Queue a move from *dc to target at speed ms per step, merged with the
+ *  previous one if it has the same speed and direction
+ */
+static int addrun(int *dc, int target, long speed, double *now)
+{
+   scriptop *prev = NOps ? &Ops[NOps - 1] : NULL;
+   int dir = target > *dc ? 1 : -1;
+
+   if(target == *dc)
+      return(0);
+   *now += (double) speed * abs(target - *dc);
+
+   if(prev && prev->op == OP_MOVE && prev->speed == speed && prev->dir == dir)
+      prev->target = target;
+   else
+   {
+      if(addop(OP_MOVE, target, speed, 0))
+         return(-1);
+      Ops[NOps - 1].dir = dir;
+   }
+
+   *dc = target;
+   return(0);
+}
+
+/*
+ *  Queue a move from *dc to target ending at the time end (ms), *now is
+ *  the time the firmware will really be at, so the rounding errors of the
+ *  previous moves are recovered.
+ *  The whole ms are split between two adjacent speeds (the slower steps
+ *  first), a move slower than 255 ms per step ends with an OP_WAIT : the
+ *  keyframe is reached on time, within 5 ms.
+ */
+static int addmove(int *dc, int target, double end, double *now)
+{
+   int steps = abs(target - *dc);
+   int dir = target > *dc ? 1 : -1;
+   long total, speed, slow, time;
+
+   if(steps)
+   {
+      total = (long) floor(end - *now + 0.5);
+      speed = total / steps;
+      slow  = total - speed * steps;    /* Steps at speed + 1 */
+      if(speed < 1)
+      {
+         speed = 1;                     /* Late, as fast as possible */
+         slow  = 0;
+      }
+      else if(speed >= 255)
+      {
+         speed = 255;                   /* The rest waited below */
+         slow  = 0;
+      }
+
+      if(addrun(dc, *dc + dir * (int) slow, speed + 1, now) ||
+         addrun(dc, target, speed, now))
+         return(-1);
+   }
+
+   time = (long) floor((end - *now) / 10 + 0.5);
+   for(; time > 0; time -= 255)
+   {
+      if(addop(OP_WAIT, 0, 0, time > 255 ? 255 : time))
+         return(-1);
+      *now += (time > 255 ? 255 : time) * 10;
+   }
+   return(0);
+}
+
+static int build(void)
+{
+   double now = 0;
+   double start, len, f;
+   int dc, k, p, pieces;
+
+   /*
+    *  First keyframe - as fast as possible
+    */
+   dc = angle2dc(Keys[0].angle);
+   if(addop(OP_MOVE, dc, 1, 0))
+      return(-1);
+
+   for(k = 1; k < NKeys; k++)
+   {
+      if(Keys[k].waitrf)
+      {
+         if(addop(OP_WAITRF, 0, 0, 0))
+            return(-1);
+         now = Keys[k - 1].time;    /* The time restarts here */
+      }
+
+      start  = Keys[k - 1].time;
+      len    = Keys[k].time - start;
+      pieces = Keys[k].ease == EASE_LINEAR ? 1 : EASEPIECES;
+      for(p = 1; p <= pieces; p++)
+      {
+         f = ease(Keys[k].ease, (double) p / pieces);
+         if(addmove(&dc, angle2dc(Keys[k - 1].angle +
+                                  (Keys[k].angle - Keys[k - 1].angle) * f),
+                    start + len * p / pieces, &now))
+            return(-1);
+      }
+   }
+
+   if(Loop)
+      return(addop(OP_LOOP, 0, 0, 0));
+   return(addop(OP_END, 0, 0, 0));
+}
+
+/*
+ *  Byte code
+ *  An OP_MOVE at the speed of the previous one, with a target near enough,
+ *  is written as OP_SLIDE. The first operation is always an OP_MOVE, so
+ *  the loop restarts with a known speed.
+ */
+static int encode(unsigned char *code, int max)
+{
+   int speed = -1, target = 0;
+   int size = 0;
+   int delta, i;
+
+   for(i = 0; i < NOps; i++)
+   {
+      scriptop *o = &Ops[i];
+
+      if(size + 3 > max)
+         return(-1);
+
+      switch(o->op)
+      {
+         case OP_MOVE:
+            delta = o->target - target;
+            if(o->speed == speed && delta >= -128 && delta <= 127)
+            {
+               code[size++] = OP_SLIDE;
+               code[size++] = (unsigned char) delta;
+            }
+            else
+            {
+               code[size++] = OP_MOVE;
+               code[size++] = o->target;
+               code[size++] = o->speed;
+            }
+            speed  = o->speed;
+            target = o->target;
+            break;
+
+         case OP_WAIT:
+            code[size++] = OP_WAIT;
+            code[size++] = o->time;
+            break;
+
+         case OP_LOOP:
+            code[size++] = OP_LOOP;
+            code[size++] = 0;
+            code[size++] = 0;
+            break;
+
+         default:
+            code[size++] = o->op;
+            break;
+      }
+   }
+   return(size);
+}
+
+static int writescript(const char *name, const char *in,
+                       const unsigned char *code, int size)
+{
+   int pc = 0;
+   FILE *fp;
+
+   fp = fopen(name, "w");
+   if(!fp)
+   {
+      perror(name);
+      return(-1);
+   }
+
+   fprintf(fp, "/*\n *  Motion script built by rfchoreo from %s\n"
+               " *  %d bytes - do not edit\n */\n"
+               "const unsigned char Script[] =\n{\n", in, size);
+   while(pc < size)
+   {
+      const unsigned char *op = &code[pc];
+
+      fprintf(fp, "   ");
+      switch(op[0])
+      {
+         case OP_MOVE:
+            fprintf(fp, "SC_MOVE(%u, %u)", op[1], op[2]);
+            pc += 3;
+            break;
+         case OP_SLIDE:
+            fprintf(fp, "SC_SLIDE(%d)", (signed char) op[1]);
+            pc += 2;
+            break;
+         case OP_WAIT:
+            fprintf(fp, "SC_WAIT(%u)", op[1]);
+            pc += 2;
+            break;
+         case OP_LOOP:
+            fprintf(fp, "SC_LOOP(%u, %u)", op[1], op[2]);
+            pc += 3;
+            break;
+         case OP_WAITRF:
+            fprintf(fp, "SC_WAITRF");
+            pc++;
+            break;
+         default:
+            fprintf(fp, "SC_END");
+            pc++;
+            break;
+      }
+      fprintf(fp, "%s   /* %3d */\n", pc < size ? "," : " ",
+              (int) (op - code));
+   }
+   fprintf(fp, "};\n");
+
+   if(fclose(fp))
+   {
+      perror(name);
+      return(-1);
+   }
+   return(0);
+}
+
+/*
+ *  Preview
+ *  The script runs as in the firmware (one step every speed ms, the next
+ *  move in the same step), the remote is assumed pressed at once and the
+ *  loop is not repeated. The servo follows the pulse width turning at most
+ *  rate degrees per ms.
+ */
+static double keyangle(unsigned long t)
+{
+   int k;
+
+   for(k = 1; k < NKeys; k++)
+      if(t <= Keys[k].time)
+      {
+         double len = Keys[k].time - Keys[k - 1].time;
+         double f = len ? ease(Keys[k].ease, (t - Keys[k - 1].time) / len) : 1;
+
+         return(Keys[k - 1].angle + (Keys[k].angle - Keys[k - 1].angle) * f);
+      }
+   return(Keys[NKeys - 1].angle);
+}
+
+static void preview(const unsigned char *code, int size, double rate,
+                    unsigned long every)
+{
+   unsigned long t = 0;
+   unsigned long wait = 0;          /* ms to the next step */
+   int dc, target, speed = 1;
+   int pc = 0;
+   double servo;
+   double cmderr = 0, servoerr = 0;
+
+   dc = target = angle2dc(Keys[0].angle);
+   servo = Keys[0].angle;
+
+   if(every)
+      printf("    ms   dc  command    servo  keyframe\n");
+
+   for(;;)
+   {
+      /*
+       *  Step
+       */
+      if(!wait)
+      {
+         while(dc == target && pc < size)
+         {
+            if(code[pc] == OP_MOVE)
+            {
+               target = code[pc + 1];
+               speed  = code[pc + 2];
+               pc += 3;
+            }
+            else if(code[pc] == OP_SLIDE)
+            {
+               target += (signed char) code[pc + 1];
+               pc += 2;
+            }
+            else if(code[pc] == OP_WAIT)
+            {
+               wait = code[pc + 1] * 10UL;
+               pc += 2;
+               break;
+            }
+            else if(code[pc] == OP_WAITRF)
+               pc++;
+            else
+               pc = size;           /* OP_END, OP_LOOP */
+         }
+
+         if(!wait)
+         {
+            if(dc == target)
+               break;               /* End of the script */
+            dc  += target > dc ? 1 : -1;
+            wait = speed;
+         }
+      }
+
+      /*
+       *  Servo model
+       */
+      if(fabs(dc2angle(dc) - servo) <= rate)
+         servo = dc2angle(dc);
+      else
+         servo += dc2angle(dc) > servo ? rate : -rate;
+
+      if(fabs(dc2angle(dc) - keyangle(t)) > cmderr)
+         cmderr = fabs(dc2angle(dc) - keyangle(t));
+      if(fabs(servo - keyangle(t)) > servoerr)
+         servoerr = fabs(servo - keyangle(t));
+
+      if(every && !(t % every))
+         printf("%6lu  %3d  %7.2f  %7.2f  %8.2f\n",
+                t, dc, dc2angle(dc), servo, keyangle(t));
+
+      t++;
+      wait--;
+   }
+
+   printf("duration  %lu ms (keyframes %lu ms)\n", t, Keys[NKeys - 1].time);
+   printf("error     command %.2f deg, servo %.2f deg (max)\n",
+          cmderr, servoerr);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned char code[SCRIPT_MAXSIZE];
+   unsigned long every = 0;
+   double rate = 400;
+   int budget = SCRIPT_MAXSIZE;
+   int size;
+   int arg;
+
+   for(arg = 1; arg < argc - 2; arg++)
+   {
+      if(!strcmp(argv[arg], "-c") && arg + 1 < argc - 2)
+      {
+         if(sscanf(argv[++arg], "%lf:%lf:%lf", &MinUs, &MaxUs, &Degrees) != 3
+            || MaxUs <= MinUs || Degrees <= 0)
+            return(usage());
+      }
+      else if(!strcmp(argv[arg], "-b") && arg + 1 < argc - 2)
+         budget = atoi(argv[++arg]);
+      else if(!strcmp(argv[arg], "-p") && arg + 1 < argc - 2)
+         every = strtoul(argv[++arg], NULL, 0);
+      else if(!strcmp(argv[arg], "-r") && arg + 1 < argc - 2)
+         rate = atof(argv[++arg]);
+      else
+         return(usage());
+   }
+   if(arg != argc - 2 || budget <= 0 || budget > SCRIPT_MAXSIZE || rate <= 0)
+      return(usage());
+
+   if(readkeys(argv[arg]) || build())
+      return(1);
+
+   size = encode(code, budget);
+   if(size < 0)
+   {
+      fprintf(stderr, "rfchoreo: the script does not fit in %d bytes\n",
+              budget);
+      return(1);
+   }
+
+   if(writescript(argv[arg + 1], argv[arg], code, size))
+      return(1);
+
+   printf("script    %d keyframes, %d bytes of %d\n", NKeys, size, budget);
+   preview(code, size, rate / 1000, every);
+   return(0);
+}
@@ -0,0 +1,769 @@
+/**
+ *  @file rfsim.c
+ *  @brief Host simulator running the rf_motor firmware on the PC
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details The firmware source is compiled as is, with the host version of
+ *  msp430x20x2.h providing the registers as variables.
+ *  The simulator replays a trace (see rftrace.h) on the input pins, calls
+ *  the interrupt routines like the hardware would do and records the output
+ *  pins in a new trace.
+ *
+ *  The time is in timer ticks (0.01 ms).
+ *  Every tick the simulator :
+ *  - applies the input edges of the tick (P1.x and P2.x channels)
+ *  - raises P1IFG / P2IFG for the edges selected by P1IES / P2IES, calls
+ *    Port1_isr() / Port2_isr() if the interrupt is enabled
+ *  - calls Timer_A()
+ *  - records the output pins changed
+ *  The main loop of the firmware runs in zero time, the ticks pass while
+ *  it sleeps in low power mode, until an interrupt wakes it up.
+ *
+ *  rfsim [-o out.rft] [-s serial.bin] [-t tail_ms] <in.rft>
+ *     Replay in.rft, report the detections and the movements of the arm,
+ *     record P1.0 (LED), P1.2 (PWM) and P1.5 (TEST) in out.rft.
+ *     The characters sent with putch() (serial.c) are saved in serial.bin,
+ *     i.e. the RF_CAPTURE dump, that is a trace itself. With RF_TXSLOT
+ *     they are decoded from P1.5, as a serial receiver would do.
+ *     The simulation ends tail_ms (default 3000) after the last input edge.
+ *
+ *  Snapshots
+ *  -w ms:file saves the complete device state at the first idle sleep of
+ *  the main loop after the time ms : every global of rf_motor.c,
+ *  the registers, the simulated time and the position in the input trace.
+ *  -r file restores it and continues from there, -u ms sets the end of the
+ *  simulation, so a long scenario can be cut in pieces and a misbehaviour
+ *  bisected starting every time from the nearest checkpoint :
+ *     rfsim -w 60000:a.snap -w 120000:b.snap long.rft
+ *     rfsim -r a.snap -u 90000 long.rft
+ *  The snapshot is valid only for the rfsim build (same firmware options)
+ *  and the input trace that produced it.
+ *
+ *  rfsim -g
+ *     Print the state machine table of the firmware (MotionFsm) as a
+ *     Graphviz graph, i.e. rfsim -g | dot -Tpng > fsm.png
+ *     The RF confirmation is a coroutine, it has no table to print.
+ *
+ *  The firmware options are selected when rfsim is built, i.e.
+ *  gcc -DRF_CAPTURE -I. -o rfsim rfsim.c rftrace.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "rftrace.h"
+
+/*
+ *  Firmware under test - main() is called by the simulator
+ */
+#define main rf_main
+#include "../RangeFinderServo/rf_motor.c"
+#undef main
+
+/*
+ *  Registers
+ */
+unsigned short SimSR;
+unsigned short SimSRIrq;
+unsigned short WDTCTL;
+unsigned char  DCOCTL, BCSCTL1, BCSCTL2;
+unsigned char  P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1REN;
+unsigned char  P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2REN;
+unsigned short TACTL, TAR, TACCTL0, TACCTL1, TACCR0, TACCR1, TAIV;
+
+/*
+ *  Simulation
+ */
+static uint64_t SimTime;             /* Current tick */
+static uint64_t SimEnd;              /* Last tick to simulate */
+static jmp_buf  SimExit;
+
+static rft_reader SimIn;             /* Input trace */
+static rft_iter   SimInIt;
+static rft_event  SimNext;           /* Next input edge */
+static int        SimNextValid;
+
+static rft_writer SimOut;            /* Output trace */
+static int        SimOutOpen;
+static const uint8_t SimOutPin[] =
+{
+   RFT_PIN(1, 0), RFT_PIN(1, 2), RFT_PIN(1, 5),
+#ifdef RF_AXIS2
+   RFT_PIN(1, 1)
+#endif
+};
+
+static FILE      *SimSerial;        /* Serial output */
+
+static unsigned char SimRfDetected;  /* Last reported values */
+static unsigned char SimLed;
+static unsigned char SimMoving;
+#ifdef RF_TXSLOT
+static int           SimTxBit = -1;  /* Serial bit received, -1 = idle */
+static unsigned char SimTxByte;
+static uint64_t      SimTxAt;        /* Next bit sample - 1/256 tick */
+#endif
+
+/*
+ *  Device state saved in the snapshots
+ *  Every global of rf_motor.c must be listed here (with the same
+ *  conditions), then the registers.
+ */
+typedef struct
+{
+   void       *addr;
+   size_t      size;
+   const char *name;
+} simvar;
+
+#define SIMVAR(v)  { (void *) &(v), sizeof(v), #v }
+
+static const simvar SimVars[] =
+{
+   SIMVAR(Pwm1_reach),
+   SIMVAR(Pwm1_dc),
+   SIMVAR(Pwm1_cn),
+   SIMVAR(Pwm1_State),
+   SIMVAR(Pwm1_delay),
+   SIMVAR(RfDetState),
+   SIMVAR(RfDetCounter),
+   SIMVAR(RfDetected),
+   SIMVAR(RfConfirmLc),
+   SIMVAR(RfPrescaler),
+   SIMVAR(RfLongDelay),
+   SIMVAR(RfAddr),
+   SIMVAR(RfToneMin),
+   SIMVAR(RfToneMax),
+#ifdef RF_DECIM
+   SIMVAR(RfDecim),
+#endif
+#ifdef RF_GOERTZEL
+   SIMVAR(GzBits),
+   SIMVAR(GzTaken),
+   SIMVAR(GzBlock),
+   SIMVAR(GzCount),
+   SIMVAR(GzCoeff),
+   SIMVAR(GzS1),
+   SIMVAR(GzS2),
+   SIMVAR(GzB1),
+   SIMVAR(GzB2),
+   SIMVAR(GzPower),
+#endif
+#ifdef RF_GESTURE
+   SIMVAR(RfPresses),
+   SIMVAR(RfPressStart),
+#endif
+#ifdef RF_HOLD
+   SIMVAR(RfHoldCmd),
+#endif
+#ifdef RF_LINKQ
+   SIMVAR(LinkSeen),
+   SIMVAR(LinkExpected),
+   SIMVAR(LinkStamp),
+   SIMVAR(LinkQuality),
+   SIMVAR(LinkBad),
+   SIMVAR(LinkBcast),
+#endif
+   SIMVAR(EvQueue),
+   SIMVAR(EvHead),
+   SIMVAR(EvTail),
+   SIMVAR(ButtonDelay),
+   SIMVAR(CmdQueue),
+   SIMVAR(CmdCount),
+   SIMVAR(CmdClock),
+   SIMVAR(CmdStamp),
+   SIMVAR(CmdLast),
+   SIMVAR(MoveQueue),
+   SIMVAR(MoveHead),
+   SIMVAR(MoveCount),
+   SIMVAR(MoveSpeed),
+   SIMVAR(MoveDwell),
+#ifdef RF_AXIS2
+   SIMVAR(Pwm2_reach),
+   SIMVAR(Pwm2_dc),
+   SIMVAR(MoveTarget2),
+   SIMVAR(DdaSteps),
+   SIMVAR(DdaLeft),
+   SIMVAR(DdaDelta),
+   SIMVAR(DdaErr),
+#endif
+#ifdef RF_RCINPUT
+   SIMVAR(RcRise),
+   SIMVAR(RcWidth),
+#endif
+#ifdef RF_IRINPUT
+   SIMVAR(IrState),
+   SIMVAR(IrBits),
+   SIMVAR(IrData),
+   SIMVAR(IrProto),
+   SIMVAR(IrAddr),
+   SIMVAR(IrCmd),
+   SIMVAR(IrToggle),
+   SIMVAR(IrLastToggle),
+#endif
+#ifdef RF_PACKET
+   SIMVAR(PktState),
+   SIMVAR(PktBits),
+   SIMVAR(PktData),
+   SIMVAR(PktAddr),
+   SIMVAR(PktCmd),
+   SIMVAR(PktCrc),
+#endif
+#ifdef RF_EDGETIME
+   SIMVAR(EdgeStamp),
+   SIMVAR(EdgeClock),
+   SIMVAR(EdgeNow),
+   SIMVAR(EdgeNowClock),
+#endif
+#ifdef RF_SCRIPT
+   SIMVAR(ScriptState),
+   SIMVAR(ScriptPc),
+   SIMVAR(ScriptLoop),
+   SIMVAR(ScriptTarget),
+   SIMVAR(ScriptSpeed),
+#endif
+#ifdef RF_SNAPSHOT
+   SIMVAR(SnapSeq),
+   SIMVAR(SnapOut),
+   SIMVAR(SnapSent),
+#endif
+#ifdef RF_TXSLOT
+   SIMVAR(TxQueue),
+   SIMVAR(TxHead),
+   SIMVAR(TxTail),
+   SIMVAR(TxShift),
+   SIMVAR(TxBits),
+   SIMVAR(TxTicks),
+   SIMVAR(TxFrac),
+#endif
+#ifdef RF_CAPTURE
+   SIMVAR(CapRing),
+   SIMVAR(CapHead),
+   SIMVAR(CapTail),
+   SIMVAR(CapUsed),
+   SIMVAR(CapEvents),
+   SIMVAR(CapLevel),
+   SIMVAR(CapFirst),
+   SIMVAR(CapState),
+   SIMVAR(CapPost),
+   SIMVAR(CapDelta),
+   SIMVAR(CapSent),
+#endif
+
+   SIMVAR(SimSR),
+   SIMVAR(WDTCTL),
+   SIMVAR(DCOCTL),
+   SIMVAR(BCSCTL1),
+   SIMVAR(BCSCTL2),
+   SIMVAR(P1IN),
+   SIMVAR(P1OUT),
+   SIMVAR(P1DIR),
+   SIMVAR(P1IFG),
+   SIMVAR(P1IES),
+   SIMVAR(P1IE),
+   SIMVAR(P1SEL),
+   SIMVAR(P1REN),
+   SIMVAR(P2IN),
+   SIMVAR(P2OUT),
+   SIMVAR(P2DIR),
+   SIMVAR(P2IFG),
+   SIMVAR(P2IES),
+   SIMVAR(P2IE),
+   SIMVAR(P2SEL),
+   SIMVAR(P2REN),
+   SIMVAR(TACTL),
+   SIMVAR(TAR),
+   SIMVAR(TACCTL0),
+   SIMVAR(TACCTL1),
+   SIMVAR(TACCR0),
+   SIMVAR(TACCR1),
+   SIMVAR(TAIV),
+
+   SIMVAR(SimTime),
+   SIMVAR(SimRfDetected),
+   SIMVAR(SimLed),
+   SIMVAR(SimMoving),
+#ifdef RF_TXSLOT
+   SIMVAR(SimTxBit),
+   SIMVAR(SimTxByte),
+   SIMVAR(SimTxAt),
+#endif
+};
+
+#define SIMNVARS    (sizeof(SimVars) / sizeof(SimVars[0]))
+#define SIMMAXSNAP  16
+#define SNAP_MAGIC  "RFSS"
+
+static struct
+{
+   uint64_t    time;
+   const char *name;
+} SimSnap[SIMMAXSNAP];               /* Snapshots to take, in time order */
+static int         SimNSnap;
+static int         SimSnapNext;
+static const char *SimRestore;       /* Snapshot to restore */
+
+/*
+ *  Run an interrupt routine like the CPU : the status register is saved
+ *  and cleared (no GIE, CPU on), the routine can change the saved one
+ *  (_BIC_SR_IRQ), reti restores it
+ */
+static void isr(void (*routine)(void))
+{
+   unsigned short saved = SimSRIrq;
+
+   SimSRIrq = SimSR;
+   SimSR   &= ~(GIE | CPUOFF | OSCOFF | SCG1);
+   routine();
+   SimSR    = SimSRIrq;
+   SimSRIrq = saved;
+}
+
+static void tick(void)
+{
+   unsigned char p1old = P1IN;
+   unsigned char p2old = P2IN;
+   unsigned char rise, fall;
+   unsigned int ch;
+
+   /*
+    *  Input edges
+    */
+   while(SimNextValid && SimNext.time <= SimTime)
+   {
+      uint8_t pin = SimIn.pin[SimNext.channel];
+      unsigned char bit = 1 << RFT_BIT(pin);
+
+      if(RFT_PORT(pin) == 1)
+         P1IN = SimNext.level ? P1IN | bit : P1IN & ~bit;
+      else
+         P2IN = SimNext.level ? P2IN | bit : P2IN & ~bit;
+      SimNextValid = !rft_next(&SimInIt, &SimNext);
+   }
+
+   /*
+    *  Interrupts - ports before the timer, as the vector priority
+    */
+   rise = ~p1old & P1IN;
+   fall = p1old & ~P1IN;
+   P1IFG |= (rise & ~P1IES) | (fall & P1IES);
+   rise = ~p2old & P2IN;
+   fall = p2old & ~P2IN;
+   P2IFG |= (rise & ~P2IES) | (fall & P2IES);
+
+   if((SimSR & GIE) && (P2IFG & P2IE))
+      isr(Port2_isr);
+   if((SimSR & GIE) && (P1IFG & P1IE))
+      isr(Port1_isr);
+   if((SimSR & GIE) && (TACCTL0 & CCIE))
+      isr(Timer_A);
+
+   /*
+    *  Outputs
+    */
+   if(SimOutOpen)
+      for(ch = 0; ch < sizeof(SimOutPin); ch++)
+         rft_edge(&SimOut, SimTime, ch, P1OUT & (1 << RFT_BIT(SimOutPin[ch])));
+
+#ifdef RF_TXSLOT
+   /*
+    *  Serial sent by Timer_A on P1.5 - every bit is sampled in its middle
+    */
+   if(SimTxBit < 0)
+   {
+      if(!(P1OUT & BIT5))
+      {
+         SimTxBit  = 0;
+         SimTxByte = 0;
+         SimTxAt   = SimTime * 256 + TX_BITQ8 * 3 / 2;
+      }
+   }
+   else if(SimTime * 256 >= SimTxAt)
+   {
+      if(SimTxBit < 8)
+      {
+         if(P1OUT & BIT5)
+            SimTxByte |= 1 << SimTxBit;
+         SimTxBit++;
+         SimTxAt += TX_BITQ8;
+      }
+      else
+      {
+         if(SimSerial && (P1OUT & BIT5))
+            fputc(SimTxByte, SimSerial);
+         SimTxBit = -1;
+      }
+   }
+#endif
+
+   if(RfDetected != SimRfDetected)
+   {
+      SimRfDetected = RfDetected;
+      printf("%10.2f ms  RfDetected %u\n", SimTime / 100.0, RfDetected);
+   }
+   if(!(P1OUT & BIT0) != !SimLed)
+   {
+      SimLed = P1OUT & BIT0;
+      printf("%10.2f ms  LED %s\n", SimTime / 100.0, SimLed ? "on" : "off");
+   }
+   if((Pwm1_State != POSIT) != SimMoving)
+   {
+      SimMoving = Pwm1_State != POSIT;
+      printf("%10.2f ms  %s Pwm1_dc %u", SimTime / 100.0,
+             SimMoving ? "move from" : "stop at", Pwm1_dc);
+#ifdef RF_AXIS2
+      printf(" Pwm2_dc %u", Pwm2_dc);
+#endif
+      printf("\n");
+   }
+
+   if(++SimTime > SimEnd)
+      longjmp(SimExit, 1);
+}
+
+/*
+ *  Hash of the snapshot layout, so a snapshot of a different build
+ *  (different firmware options) is refused
+ */
+static uint32_t layout(void)
+{
+   uint32_t hash = 2166136261u;
+   const char *p;
+   unsigned int v;
+
+   for(v = 0; v < SIMNVARS; v++)
+   {
+      for(p = SimVars[v].name; *p; p++)
+         hash = (hash ^ (uint8_t) *p) * 16777619u;
+      hash = (hash ^ (uint32_t) SimVars[v].size) * 16777619u;
+   }
+   return(hash);
+}
+
+/*
+ *  Snapshot file : magic, layout hash, events in the input trace, then the
+ *  variables in the SimVars order
+ */
+static int snapsave(const char *name)
+{
+   uint32_t hash = layout();
+   unsigned int v;
+   FILE *fp;
+
+   fp = fopen(name, "wb");
+   if(!fp)
+      return(-1);
+
+   fwrite(SNAP_MAGIC, 4, 1, fp);
+   fwrite(&hash, sizeof(hash), 1, fp);
+   fwrite(&SimIn.nevents, sizeof(SimIn.nevents), 1, fp);
+   for(v = 0; v < SIMNVARS; v++)
+      fwrite(SimVars[v].addr, SimVars[v].size, 1, fp);
+
+   if(ferror(fp))
+   {
+      fclose(fp);
+      return(-1);
+   }
+   return(fclose(fp));
+}
+
+static int snapload(const char *name)
+{
+   char magic[4];
+   uint32_t hash;
+   uint64_t nevents;
+   unsigned int v;
+   FILE *fp;
+
+   fp = fopen(name, "rb");
+   if(!fp)
+      return(-1);
+
+   if(fread(magic, 4, 1, fp) != 1 || memcmp(magic, SNAP_MAGIC, 4) ||
+      fread(&hash, sizeof(hash), 1, fp) != 1 || hash != layout() ||
+      fread(&nevents, sizeof(nevents), 1, fp) != 1 ||
+      nevents != SimIn.nevents)
+   {
+      fclose(fp);
+      return(-1);
+   }
+
+   for(v = 0; v < SIMNVARS; v++)
+      if(fread(SimVars[v].addr, SimVars[v].size, 1, fp) != 1)
+      {
+         fclose(fp);
+         return(-1);
+      }
+   fclose(fp);
+
+   /*
+    *  Pending input edges - the ones up to SimTime - 1 are applied
+    */
+   SimNextValid = !rft_seek(&SimIn, &SimInIt, SimTime) &&
+                  !rft_next(&SimInIt, &SimNext);
+   return(0);
+}
+
+/**
+ * SimBisSr
+ * @brief Set bits in the status register
+ *
+ * Entering a low power mode (CPUOFF) the ticks are simulated until an
+ * interrupt routine clears CPUOFF in the saved status register
+ * (_BIC_SR_IRQ, see isr), waking up the main loop.
+ *
+ * @param bits bits to set
+ * @return None
+ */
+void SimBisSr(unsigned short bits)
+{
+   SimSR |= bits;
+   while(SimSR & CPUOFF)
+      tick();
+}
+
+/**
+ * SimIdle
+ * @brief Sleep of the main loop (__low_power_mode_0)
+ *
+ * The only point where the snapshots are saved and restored : the main
+ * loop is going to sleep with the event queue empty and no handler
+ * running, so after a restore it continues exactly like the original run.
+ * A sleep anywhere else (SimBisSr) has a C call chain the snapshot cannot
+ * hold.
+ *
+ * @return None
+ */
+void SimIdle(void)
+{
+   if(SimRestore)
+   {
+      if(snapload(SimRestore))
+      {
+         fprintf(stderr, "rfsim: %s: not a snapshot of this build and trace\n",
+                 SimRestore);
+         exit(1);
+      }
+      printf("%10.2f ms  restored %s\n", SimTime / 100.0, SimRestore);
+      SimRestore = NULL;
+   }
+
+   if(SimSnapNext < SimNSnap && SimTime >= SimSnap[SimSnapNext].time)
+   {
+      if(snapsave(SimSnap[SimSnapNext].name))
+      {
+         perror(SimSnap[SimSnapNext].name);
+         exit(1);
+      }
+      printf("%10.2f ms  saved %s\n", SimTime / 100.0,
+             SimSnap[SimSnapNext].name);
+      SimSnapNext++;
+   }
+
+   SimBisSr(LPM0_bits + GIE);
+}
+
+/**
+ * putch
+ * @brief Host version of the serial.c transmission
+ *
+ * @param c character to send
+ * @return None
+ */
+void putch(char c)
+{
+   if(SimSerial)
+      fputc(c, SimSerial);
+}
+
+/*
+ *  State machine tables export
+ *  The names must follow the state and event defines of rf_motor.c
+ */
+static const char *const SimMotionStates[MOTION_STATES] =
+   { "POSIT", "WAITINGUP", "WAITINGDOWN" };
+static const char *const SimMotionEvents[MOTION_EVENTS] =
+   { "EV_STEP", "EV_MOVE" };
+
+static const struct
+{
+   unsigned char (*action)(void);
+   const char *name;
+} SimActions[] =
+{
+   { MotionStep,  "MotionStep" }
+};
+
+static const char *actionname(unsigned char (*action)(void))
+{
+   unsigned int a;
+
+   for(a = 0; a < sizeof(SimActions) / sizeof(SimActions[0]); a++)
+      if(SimActions[a].action == action)
+         return(SimActions[a].name);
+   return("?");
+}
+
+static void graph(const char *name, const struct FsmTrans *table,
+                  int nstates, int nevents,
+                  const char *const *states, const char *const *events)
+{
+   const struct FsmTrans *t;
+   int st, ev, br;
+
+   printf("  subgraph cluster_%s {\n    label=\"%s\";\n", name, name);
+   for(st = 0; st < nstates; st++)
+      printf("    %s_%s [label=\"%s\"];\n", name, states[st], states[st]);
+
+   for(st = 0; st < nstates; st++)
+      for(ev = 0; ev < nevents; ev++)
+      {
+         t = &table[st * nevents + ev];
+         if(!t->action && t->next[0] == FSM_STAY)
+            continue;                   /* Event ignored */
+
+         for(br = 0; br < FSM_BRANCHES; br++)
+         {
+            int next = t->next[br] == FSM_STAY ? st : t->next[br];
+
+            if(t->next[br] == FSM_NONE || next >= nstates)
+               continue;
+            printf("    %s_%s -> %s_%s [label=\"%s", name, states[st],
+                   name, states[next], events[ev]);
+            if(t->action)
+               printf(" / %s:%d", actionname(t->action), br);
+            printf("\"];\n");
+         }
+      }
+   printf("  }\n");
+}
+
+static int usage(void)
+{
+   fprintf(stderr,
+           "usage: rfsim [-o out.rft] [-s serial.bin] [-t tail_ms | -u ms]\n"
+           "             [-w ms:snapshot ...] [-r snapshot] <in.rft>\n"
+           "       rfsim -g\n");
+   return(1);
+}
+
+int main(int argc, char **argv)
+{
+   static const char *out;          /* Static, survives the longjmp */
+   unsigned long tail = 3000;
+   unsigned long until = 0;
+   unsigned long ms;
+   char *name;
+   uint8_t level[sizeof(SimOutPin)];
+   uint64_t last = 0;
+   rft_iter it;
+   rft_event ev;
+   int arg;
+
+   if(argc == 2 && !strcmp(argv[1], "-g"))
+   {
+      printf("digraph rf_motor {\n");
+      graph("MotionFsm", &MotionFsm[0][0], MOTION_STATES, MOTION_EVENTS,
+            SimMotionStates, SimMotionEvents);
+      printf("}\n");
+      return(0);
+   }
+
+   for(arg = 1; arg < argc - 1; arg++)
+   {
+      if(!strcmp(argv[arg], "-o"))
+         out = argv[++arg];
+      else if(!strcmp(argv[arg], "-s"))
+      {
+         SimSerial = fopen(argv[++arg], "wb");
+         if(!SimSerial)
+         {
+            perror(argv[arg]);
+            return(1);
+         }
+      }
+      else if(!strcmp(argv[arg], "-t"))
+         tail = strtoul(argv[++arg], NULL, 0);
+      else if(!strcmp(argv[arg], "-u"))
+         until = strtoul(argv[++arg], NULL, 0);
+      else if(!strcmp(argv[arg], "-r"))
+         SimRestore = argv[++arg];
+      else if(!strcmp(argv[arg], "-w"))
+      {
+         ms = strtoul(argv[++arg], &name, 0);
+         if(*name++ != ':' || !*name || SimNSnap == SIMMAXSNAP ||
+            (SimNSnap && ms * 100ULL < SimSnap[SimNSnap - 1].time))
+            return(usage());
+         SimSnap[SimNSnap].time = ms * 100ULL;
+         SimSnap[SimNSnap].name = name;
+         SimNSnap++;
+      }
+      else
+         return(usage());
+   }
+   if(arg != argc - 1)
+      return(usage());
+
+   if(rft_open(&SimIn, argv[arg]))
+   {
+      fprintf(stderr, "rfsim: %s: not a valid trace\n", argv[arg]);
+      return(1);
+   }
+
+   for(arg = 0; arg < SimIn.nchan; arg++)
+   {
+      uint8_t pin = SimIn.pin[arg];
+      unsigned char bit = 1 << RFT_BIT(pin);
+
+      if(RFT_PORT(pin) == 1 && SimIn.level[arg])
+         P1IN |= bit;
+      if(RFT_PORT(pin) == 2 && SimIn.level[arg])
+         P2IN |= bit;
+   }
+
+   rft_begin(&SimIn, &it);
+   while(!rft_next(&it, &ev))
+      last = ev.time;
+   SimEnd = until ? until * 100ULL : last + tail * 100ULL;
+
+   rft_begin(&SimIn, &SimInIt);
+   SimNextValid = !rft_next(&SimInIt, &SimNext);
+
+   if(out)
+   {
+      memset(level, 0, sizeof(level));
+      if(rft_create(&SimOut, out, sizeof(SimOutPin), SimOutPin, level,
+                    RFT_TICKNS))
+      {
+         perror(out);
+         return(1);
+      }
+      SimOutOpen = 1;
+   }
+
+   if(!setjmp(SimExit))
+      rf_main();
+
+   printf("%10.2f ms  end, Pwm1_dc %u\n", SimTime / 100.0, Pwm1_dc);
+#ifdef RF_SNAPSHOT
+   {
+      struct Snap snap;
+
+      SnapRead(&snap);
+      printf("              snapshot %u : Pwm1_cn %u, delay %u, long %u, "
+             "clock %u, RF %u\n", SnapSeq, snap.pwm_cn, snap.pwm_delay,
+             snap.long_delay, snap.clock, snap.detected);
+   }
+#endif
+
+   if(SimOutOpen && rft_finish(&SimOut))
+   {
+      perror(out);
+      return(1);
+   }
+   if(SimSerial)
+      fclose(SimSerial);
+   rft_close(&SimIn);
+   return(0);
+}
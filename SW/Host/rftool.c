@@ -0,0 +1,386 @@
+/**
+ *  @file rftool.c
+ *  @brief Command line tool for the binary traces
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details Convert, inspect and generate traces in the format described
+ *  in rftrace.h.
+ *
+ *  rftool encode <in.txt> <out.rft> <pin>[,<pin>...]
+ *     Convert a text trace, one edge per line : "tick channel level".
+ *     The pins (i.e. P1.6,P1.2) are assigned to the channels 0, 1, ...
+ *  rftool dump <in.rft> [from [to]]
+ *     Print the edges in the same text format accepted by encode
+ *  rftool info <in.rft>
+ *     Print the header, the block index summary and the edges per channel
+ *  rftool vcd <in.rft> <out.vcd>
+ *     Convert in Value Change Dump, to be seen with any waveform viewer
+ *  rftool tone <out.rft> <hz> <start_ms>:<length_ms> [...]
+ *     Generate a square wave on P1.6 (the RF receiver input) for every
+ *     start:length burst, i.e. a remote pressed for the burst length
+ *  rftool packet <out.rft> <addr>:<cmd>@<start_ms> [...]
+ *     Generate on P1.6 a RF packet (see rf_packet.h) for every
+ *     addr:cmd@start, i.e. 1:4@500 sends CMD_STOP to the device 1 at
+ *     500 ms. The numbers can be hex (0x..).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rftrace.h"
+#define RF_PACKET                  /* PktCrc8 of rf_packet.h */
+#include "../RangeFinderServo/rf_packet.h"
+
+static int usage(void)
+{
+   fprintf(stderr,
+           "usage: rftool encode <in.txt> <out.rft> <pin>[,<pin>...]\n"
+           "       rftool dump <in.rft> [from [to]]\n"
+           "       rftool info <in.rft>\n"
+           "       rftool vcd <in.rft> <out.vcd>\n"
+           "       rftool tone <out.rft> <hz> <start_ms>:<length_ms> [...]\n"
+           "       rftool packet <out.rft> <addr>:<cmd>@<start_ms> [...]\n");
+   return(1);
+}
+
+static int openin(rft_reader *rd, const char *name)
+{
+   if(rft_open(rd, name))
+   {
+      fprintf(stderr, "rftool: %s: not a valid trace\n", name);
+      return(-1);
+   }
+   return(0);
+}
+
+/*
+ *  encode
+ */
+static int encode(const char *in, const char *out, char *pins)
+{
+   uint8_t pin[RFT_MAXCHAN];
+   uint8_t level[RFT_MAXCHAN];
+   uint8_t nchan = 0;
+   unsigned long long tick;
+   unsigned ch, lev;
+   rft_writer wr;
+   char line[128];
+   char *name;
+   long lineno = 0;
+   FILE *fp;
+
+   memset(level, 0, sizeof(level));
+   for(name = strtok(pins, ","); name; name = strtok(NULL, ","))
+   {
+      if(nchan == RFT_MAXCHAN || rft_parsepin(name, &pin[nchan]))
+      {
+         fprintf(stderr, "rftool: invalid pin list\n");
+         return(1);
+      }
+      nchan++;
+   }
+
+   fp = fopen(in, "r");
+   if(!fp)
+   {
+      perror(in);
+      return(1);
+   }
+
+   if(rft_create(&wr, out, nchan, pin, level, RFT_TICKNS))
+   {
+      perror(out);
+      fclose(fp);
+      return(1);
+   }
+
+   while(fgets(line, sizeof(line), fp))
+   {
+      lineno++;
+      if(line[0] == '#' || line[0] == '\n')
+         continue;
+      if(sscanf(line, "%llu %u %u", &tick, &ch, &lev) != 3 ||
+         rft_edge(&wr, tick, ch, lev))
+      {
+         fprintf(stderr, "rftool: %s:%ld: invalid edge\n", in, lineno);
+         fclose(fp);
+         rft_finish(&wr);
+         return(1);
+      }
+   }
+
+   fclose(fp);
+   if(rft_finish(&wr))
+   {
+      perror(out);
+      return(1);
+   }
+   return(0);
+}
+
+/*
+ *  dump
+ */
+static int dump(const char *in, uint64_t from, uint64_t to)
+{
+   rft_reader rd;
+   rft_iter it;
+   rft_event ev;
+   char name[8];
+   int ch;
+
+   if(openin(&rd, in))
+      return(1);
+
+   printf("#");
+   for(ch = 0; ch < rd.nchan; ch++)
+   {
+      rft_pinname(rd.pin[ch], name);
+      printf(" %s", name);
+   }
+   printf("\n");
+
+   if(!rft_seek(&rd, &it, from))
+      while(!rft_next(&it, &ev) && ev.time <= to)
+         printf("%llu %u %u\n", (unsigned long long) ev.time,
+                ev.channel, ev.level);
+
+   rft_close(&rd);
+   return(0);
+}
+
+/*
+ *  info
+ */
+static int info(const char *in)
+{
+   uint64_t edges[RFT_MAXCHAN];
+   uint64_t last = 0;
+   rft_reader rd;
+   rft_iter it;
+   rft_event ev;
+   char name[8];
+   int ch;
+
+   if(openin(&rd, in))
+      return(1);
+
+   memset(edges, 0, sizeof(edges));
+   rft_begin(&rd, &it);
+   while(!rft_next(&it, &ev))
+   {
+      edges[ev.channel]++;
+      last = ev.time;
+   }
+
+   printf("tick      %u ns\n", rd.tickns);
+   printf("events    %llu in %u blocks (%u per block)\n",
+          (unsigned long long) rd.nevents, rd.nblocks, rd.blockevents);
+   printf("length    %llu ticks (%.3f s)\n", (unsigned long long) last,
+          last * (double) rd.tickns / 1e9);
+   printf("size      %lu bytes (%.2f bytes per event)\n",
+          (unsigned long) rd.size,
+          rd.nevents ? (double) rd.size / rd.nevents : 0.0);
+   for(ch = 0; ch < rd.nchan; ch++)
+   {
+      rft_pinname(rd.pin[ch], name);
+      printf("channel %d %s initial %u edges %llu\n", ch, name,
+             rd.level[ch], (unsigned long long) edges[ch]);
+   }
+
+   rft_close(&rd);
+   return(0);
+}
+
+/*
+ *  vcd
+ */
+static int vcd(const char *in, const char *out)
+{
+   rft_reader rd;
+   rft_iter it;
+   rft_event ev;
+   char name[8];
+   FILE *fp;
+   int ch;
+
+   if(openin(&rd, in))
+      return(1);
+
+   fp = fopen(out, "w");
+   if(!fp)
+   {
+      perror(out);
+      rft_close(&rd);
+      return(1);
+   }
+
+   fprintf(fp, "$timescale 1 ns $end\n$scope module rf $end\n");
+   for(ch = 0; ch < rd.nchan; ch++)
+   {
+      rft_pinname(rd.pin[ch], name);
+      name[2] = '_';               /* P1.6 -> P1_6 */
+      fprintf(fp, "$var wire 1 %c %s $end\n", '!' + ch, name);
+   }
+   fprintf(fp, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+   for(ch = 0; ch < rd.nchan; ch++)
+      fprintf(fp, "%u%c\n", rd.level[ch], '!' + ch);
+   fprintf(fp, "$end\n");
+
+   rft_begin(&rd, &it);
+   while(!rft_next(&it, &ev))
+      fprintf(fp, "#%llu\n%u%c\n",
+              (unsigned long long) ev.time * rd.tickns,
+              ev.level, '!' + ev.channel);
+
+   rft_close(&rd);
+   if(fclose(fp))
+   {
+      perror(out);
+      return(1);
+   }
+   return(0);
+}
+
+/*
+ *  tone
+ */
+static int tone(const char *out, double hz, int nburst, char **burst)
+{
+   uint8_t pin = RFT_PIN(1, 6);
+   uint8_t level = 0;
+   double half = 1e9 / hz / 2 / RFT_TICKNS;   /* Half period in ticks */
+   unsigned long start, length;
+   rft_writer wr;
+   int b;
+
+   if(hz <= 0 || half < 1)
+      return(usage());
+
+   if(rft_create(&wr, out, 1, &pin, &level, RFT_TICKNS))
+   {
+      perror(out);
+      return(1);
+   }
+
+   for(b = 0; b < nburst; b++)
+   {
+      uint64_t t0, end;
+      long n;
+
+      if(sscanf(burst[b], "%lu:%lu", &start, &length) != 2)
+      {
+         rft_finish(&wr);
+         return(usage());
+      }
+
+      t0  = start * 100ULL;            /* ms -> ticks */
+      end = t0 + length * 100ULL;
+      for(n = 0; t0 + (uint64_t) (n * half) < end; n++)
+      {
+         if(rft_edge(&wr, t0 + (uint64_t) (n * half), 0, !(n & 1)))
+         {
+            fprintf(stderr, "rftool: bursts must be in time order\n");
+            rft_finish(&wr);
+            return(1);
+         }
+      }
+      rft_edge(&wr, end, 0, 0);
+   }
+
+   if(rft_finish(&wr))
+   {
+      perror(out);
+      return(1);
+   }
+   return(0);
+}
+
+/*
+ *  packet
+ */
+static int packet(const char *out, int npkt, char **pkt)
+{
+   uint8_t pin = RFT_PIN(1, 6);
+   uint8_t level = 0;
+   uint64_t t, last = 0;
+   long addr, cmd;
+   unsigned long start, data;
+   rft_writer wr;
+   int p, i;
+
+   if(rft_create(&wr, out, 1, &pin, &level, RFT_TICKNS))
+   {
+      perror(out);
+      return(1);
+   }
+
+   for(p = 0; p < npkt; p++)
+   {
+      if(sscanf(pkt[p], "%li:%li@%lu", &addr, &cmd, &start) != 3 ||
+         addr < 0 || addr > 0xFF || cmd < 0 || cmd > 0xFF)
+      {
+         rft_finish(&wr);
+         return(usage());
+      }
+
+      t = start * 100ULL;              /* ms -> ticks */
+      if(p && t < last)
+      {
+         fprintf(stderr, "rftool: packets must be in time order\n");
+         rft_finish(&wr);
+         return(1);
+      }
+
+      for(i = 0; i < PKT_PREAMBLE; i++)
+      {
+         rft_edge(&wr, t, 0, 1);
+         t += PKT_PRE_US * 1000ULL / RFT_TICKNS;
+         rft_edge(&wr, t, 0, 0);
+         t += PKT_PRE_US * 1000ULL / RFT_TICKNS;
+      }
+      t += (PKT_SYNC_US - PKT_PRE_US) * 1000ULL / RFT_TICKNS;
+
+      data = ((unsigned long) addr << 16) | ((unsigned long) cmd << 8) |
+             PktCrc8(PktCrc8(0, (unsigned char) addr), (unsigned char) cmd);
+      for(i = PKT_BITS - 1; i >= 0; i--)
+      {
+         int one = (data >> i) & 1;
+
+         rft_edge(&wr, t, 0, 1);
+         t += (one ? PKT_LONG_US : PKT_SHORT_US) * 1000ULL / RFT_TICKNS;
+         rft_edge(&wr, t, 0, 0);
+         t += (one ? PKT_SHORT_US : PKT_LONG_US) * 1000ULL / RFT_TICKNS;
+      }
+      last = t;
+   }
+
+   if(rft_finish(&wr))
+   {
+      perror(out);
+      return(1);
+   }
+   return(0);
+}
+
+int main(int argc, char **argv)
+{
+   if(argc < 3)
+      return(usage());
+
+   if(!strcmp(argv[1], "encode") && argc == 5)
+      return(encode(argv[2], argv[3], argv[4]));
+   if(!strcmp(argv[1], "dump") && argc >= 3 && argc <= 5)
+      return(dump(argv[2],
+                  argc > 3 ? strtoull(argv[3], NULL, 0) : 0,
+                  argc > 4 ? strtoull(argv[4], NULL, 0) : UINT64_MAX));
+   if(!strcmp(argv[1], "info") && argc == 3)
+      return(info(argv[2]));
+   if(!strcmp(argv[1], "vcd") && argc == 4)
+      return(vcd(argv[2], argv[3]));
+   if(!strcmp(argv[1], "tone") && argc >= 5)
+      return(tone(argv[2], atof(argv[3]), argc - 4, argv + 4));
+   if(!strcmp(argv[1], "packet") && argc >= 4)
+      return(packet(argv[2], argc - 3, argv + 3));
+
+   return(usage());
+}
@@ -0,0 +1,512 @@
+/**
+ *  @file rftrace.c
+ *  @brief Reader and writer for the compact binary trace format
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details See rftrace.h for the file layout.
+ *  The reader maps the whole file (mmap) and decodes the events directly
+ *  from the mapping, so also traces of hours are opened immediately and
+ *  never loaded in memory.
+ *  The writer streams the blocks to the file and keeps in memory only the
+ *  block index, written at the end by rft_finish().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rftrace.h"
+
+/*
+ *  Little endian helpers
+ */
+static uint64_t getle(const uint8_t *p, int size)
+{
+   uint64_t value = 0;
+
+   while(size--)
+      value = (value << 8) | p[size];
+   return(value);
+}
+
+static void putle(uint8_t *p, uint64_t value, int size)
+{
+   while(size--)
+   {
+      *p++ = (uint8_t) value;
+      value >>= 8;
+   }
+}
+
+/**
+ * rft_open
+ * @brief Open and map a trace for reading
+ *
+ * @param rd   reader to initialize
+ * @param name file name
+ * @return 0 if ok, -1 on error (errno set or invalid file)
+ */
+int rft_open(rft_reader *rd, const char *name)
+{
+   struct stat st;
+   const uint8_t *map;
+   uint64_t index;
+   uint64_t offset;
+   uint32_t block;
+   rft_block blk;
+   int fd;
+   int ch;
+
+   memset(rd, 0, sizeof(*rd));
+
+   fd = open(name, O_RDONLY);
+   if(fd < 0)
+      return(-1);
+
+   if(fstat(fd, &st) < 0 || st.st_size < RFT_HEADERSIZE)
+   {
+      close(fd);
+      return(-1);
+   }
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);                       /* The mapping keeps the file */
+   if(map == MAP_FAILED)
+      return(-1);
+
+   rd->map  = map;
+   rd->size = st.st_size;
+
+   if(memcmp(map, RFT_MAGIC, 4) || map[4] != RFT_VERSION ||
+      map[5] == 0 || map[5] > RFT_MAXCHAN)
+   {
+      rft_close(rd);
+      return(-1);
+   }
+
+   rd->nchan       = map[5];
+   rd->blockevents = (uint16_t) getle(map + 6, 2);
+   rd->tickns      = (uint32_t) getle(map + 8, 4);
+   rd->nblocks     = (uint32_t) getle(map + 12, 4);
+   index           = getle(map + 16, 8);
+   rd->nevents     = getle(map + 24, 8);
+
+   for(ch = 0; ch < rd->nchan; ch++)
+   {
+      rd->pin[ch]   = map[32 + ch * 2];
+      rd->level[ch] = map[33 + ch * 2] ? 1 : 0;
+   }
+
+   if(index < RFT_HEADERSIZE || index > rd->size ||
+      rd->nblocks > (rd->size - index) / RFT_INDEXSIZE)
+   {
+      rft_close(rd);
+      return(-1);
+   }
+   rd->index = map + index;
+
+   /*
+    *  The blocks must lie between the header and the index, in order :
+    *  every block ends where the next one starts, so the events are never
+    *  decoded past the mapping (truncated or corrupted file)
+    */
+   offset = RFT_HEADERSIZE;
+   for(block = 0; block < rd->nblocks; block++)
+   {
+      rft_getblock(rd, block, &blk);
+      if(blk.offset < offset || blk.offset > index)
+      {
+         rft_close(rd);
+         return(-1);
+      }
+      offset = blk.offset;
+   }
+   return(0);
+}
+
+/**
+ * rft_close
+ * @brief Release a trace opened by rft_open()
+ *
+ * @param rd reader
+ * @return None
+ */
+void rft_close(rft_reader *rd)
+{
+   if(rd->map)
+      munmap((void *) rd->map, rd->size);
+   memset(rd, 0, sizeof(*rd));
+}
+
+/**
+ * rft_getblock
+ * @brief Read an entry of the block index
+ *
+ * @param rd    reader
+ * @param block block number (0 .. nblocks - 1)
+ * @param blk   decoded entry
+ * @return None
+ */
+void rft_getblock(const rft_reader *rd, uint32_t block, rft_block *blk)
+{
+   const uint8_t *p = rd->index + (size_t) block * RFT_INDEXSIZE;
+
+   blk->start  = getle(p, 8);
+   blk->offset = getle(p + 8, 8);
+   blk->events = (uint32_t) getle(p + 16, 4);
+   blk->levels = p[20];
+}
+
+/*
+ *  Position an iterator at the start of a block
+ */
+static void loadblock(const rft_reader *rd, rft_iter *it, uint32_t block)
+{
+   rft_block blk;
+
+   it->block = block;
+   if(block >= rd->nblocks)
+   {
+      it->pos = it->end = NULL;
+      it->left = 0;
+      return;
+   }
+
+   rft_getblock(rd, block, &blk);
+   it->time   = blk.start;
+   it->levels = blk.levels;
+   it->left   = blk.events;
+   it->pos    = rd->map + blk.offset;
+
+   if(block + 1 < rd->nblocks)
+   {
+      rft_getblock(rd, block + 1, &blk);
+      it->end = rd->map + blk.offset;
+   }
+   else
+      it->end = rd->index;
+}
+
+/**
+ * rft_begin
+ * @brief Start iterating a trace from the first event
+ *
+ * @param rd reader
+ * @param it iterator to initialize
+ * @return None
+ */
+void rft_begin(const rft_reader *rd, rft_iter *it)
+{
+   int ch;
+
+   memset(it, 0, sizeof(*it));
+   it->rd = rd;
+   for(ch = 0; ch < rd->nchan; ch++)
+      it->levels |= rd->level[ch] << ch;
+   loadblock(rd, it, 0);
+}
+
+/**
+ * rft_seek
+ * @brief Position an iterator on the first event at or after a time
+ *
+ * The block is found with a binary search on the index, then the events
+ * are decoded up to the requested time.
+ * After the call the iterator levels are the ones valid at the time.
+ *
+ * @param rd   reader
+ * @param it   iterator to initialize
+ * @param time time in ticks
+ * @return 0 if ok, -1 if the time is after the end of the trace
+ */
+int rft_seek(const rft_reader *rd, rft_iter *it, uint64_t time)
+{
+   rft_block blk;
+   uint32_t lo = 0;
+   uint32_t hi = rd->nblocks;
+   rft_iter save;
+   rft_event ev;
+
+   rft_begin(rd, it);
+
+   /* Last block starting at or before the time */
+   while(hi - lo > 1)
+   {
+      uint32_t mid = (lo + hi) / 2;
+
+      rft_getblock(rd, mid, &blk);
+      if(blk.start <= time)
+         lo = mid;
+      else
+         hi = mid;
+   }
+   loadblock(rd, it, lo);
+
+   for(;;)
+   {
+      save = *it;
+      if(rft_next(it, &ev))
+         return(-1);
+      if(ev.time >= time)
+      {
+         *it = save;
+         return(0);
+      }
+   }
+}
+
+/**
+ * rft_next
+ * @brief Decode the next event
+ *
+ * @param it iterator
+ * @param ev decoded event
+ * @return 0 if ok, -1 at the end of the trace (or on a corrupted block)
+ */
+int rft_next(rft_iter *it, rft_event *ev)
+{
+   uint64_t value = 0;
+   int shift = 0;
+
+   while(!it->left)
+   {
+      if(it->block >= it->rd->nblocks)
+         return(-1);
+      loadblock(it->rd, it, it->block + 1);
+   }
+
+   do
+   {
+      if(it->pos >= it->end || shift > 63)
+         return(-1);
+      value |= (uint64_t) (*it->pos & 0x7F) << shift;
+      shift += 7;
+   }
+   while(*it->pos++ & 0x80);
+
+   it->left--;
+   it->time  += value >> 3;
+   it->levels ^= 1 << (value & 7);
+
+   ev->time    = it->time;
+   ev->channel = value & 7;
+   ev->level   = (it->levels >> ev->channel) & 1;
+   return(0);
+}
+
+/*
+ *  Writer
+ */
+
+static int writeheader(rft_writer *wr, uint64_t index)
+{
+   uint8_t head[RFT_HEADERSIZE];
+   int ch;
+
+   memset(head, 0, sizeof(head));
+   memcpy(head, RFT_MAGIC, 4);
+   head[4] = RFT_VERSION;
+   head[5] = wr->nchan;
+   putle(head + 6, wr->blockevents, 2);
+   putle(head + 8, wr->tickns, 4);
+   putle(head + 12, wr->nblocks, 4);
+   putle(head + 16, index, 8);
+   putle(head + 24, wr->nevents, 8);
+   for(ch = 0; ch < wr->nchan; ch++)
+   {
+      head[32 + ch * 2] = wr->pin[ch];
+      head[33 + ch * 2] = wr->level[ch];
+   }
+
+   if(fseek(wr->fp, 0, SEEK_SET) ||
+      fwrite(head, sizeof(head), 1, wr->fp) != 1)
+      return(-1);
+   return(0);
+}
+
+/**
+ * rft_create
+ * @brief Create a trace for writing
+ *
+ * @param wr     writer to initialize
+ * @param name   file name
+ * @param nchan  number of channels (1..RFT_MAXCHAN)
+ * @param pin    pin of every channel (see RFT_PIN)
+ * @param level  initial level of every channel
+ * @param tickns tick duration in nSec
+ * @return 0 if ok, -1 on error
+ */
+int rft_create(rft_writer *wr, const char *name, uint8_t nchan,
+               const uint8_t *pin, const uint8_t *level, uint32_t tickns)
+{
+   int ch;
+
+   memset(wr, 0, sizeof(*wr));
+   if(nchan == 0 || nchan > RFT_MAXCHAN)
+      return(-1);
+
+   wr->fp = fopen(name, "wb");
+   if(!wr->fp)
+      return(-1);
+
+   wr->nchan       = nchan;
+   wr->blockevents = RFT_BLOCKEVENTS;
+   wr->tickns      = tickns;
+   for(ch = 0; ch < nchan; ch++)
+   {
+      wr->pin[ch]   = pin[ch];
+      wr->level[ch] = level[ch] ? 1 : 0;
+      wr->levels   |= wr->level[ch] << ch;
+   }
+
+   if(writeheader(wr, 0))       /* Placeholder, rewritten at the end */
+   {
+      fclose(wr->fp);
+      wr->fp = NULL;
+      return(-1);
+   }
+   wr->offset = RFT_HEADERSIZE;
+   return(0);
+}
+
+/**
+ * rft_edge
+ * @brief Add an edge to the trace
+ *
+ * A call that does not change the level of the channel is ignored, so
+ * the caller can simply report the pin status every time it is sampled.
+ *
+ * @param wr      writer
+ * @param time    time in ticks, never before the previous edge
+ * @param channel channel
+ * @param level   new level of the channel
+ * @return 0 if ok, -1 on error
+ */
+int rft_edge(rft_writer *wr, uint64_t time, uint8_t channel, uint8_t level)
+{
+   uint8_t buf[10];
+   uint64_t value;
+   int len = 0;
+
+   if(channel >= wr->nchan || time < wr->time)
+      return(-1);
+
+   level = level ? 1 : 0;
+   if(((wr->levels >> channel) & 1) == level)
+      return(0);
+
+   if(!wr->inblock || wr->inblock >= wr->blockevents)
+   {
+      /*
+       *  Open a new block, the time base is the previous edge
+       */
+      if(wr->nblocks == wr->maxblocks)
+      {
+         rft_block *blocks;
+
+         wr->maxblocks = wr->maxblocks ? wr->maxblocks * 2 : 64;
+         blocks = realloc(wr->blocks, wr->maxblocks * sizeof(rft_block));
+         if(!blocks)
+            return(-1);
+         wr->blocks = blocks;
+      }
+      wr->blocks[wr->nblocks].start  = wr->time;
+      wr->blocks[wr->nblocks].offset = wr->offset;
+      wr->blocks[wr->nblocks].events = 0;
+      wr->blocks[wr->nblocks].levels = wr->levels;
+      wr->nblocks++;
+      wr->inblock = 0;
+   }
+
+   value = ((time - wr->time) << 3) | channel;
+   do
+   {
+      buf[len] = value & 0x7F;
+      value >>= 7;
+      if(value)
+         buf[len] |= 0x80;
+      len++;
+   }
+   while(value);
+
+   if(fwrite(buf, len, 1, wr->fp) != 1)
+      return(-1);
+
+   wr->offset += len;
+   wr->time    = time;
+   wr->levels ^= 1 << channel;
+   wr->inblock++;
+   wr->nevents++;
+   wr->blocks[wr->nblocks - 1].events++;
+   return(0);
+}
+
+/**
+ * rft_finish
+ * @brief Write the block index, update the header and close the trace
+ *
+ * @param wr writer
+ * @return 0 if ok, -1 on error
+ */
+int rft_finish(rft_writer *wr)
+{
+   uint8_t entry[RFT_INDEXSIZE];
+   uint64_t index = wr->offset;
+   uint32_t block;
+   int err = 0;
+
+   for(block = 0; block < wr->nblocks && !err; block++)
+   {
+      memset(entry, 0, sizeof(entry));
+      putle(entry, wr->blocks[block].start, 8);
+      putle(entry + 8, wr->blocks[block].offset, 8);
+      putle(entry + 16, wr->blocks[block].events, 4);
+      entry[20] = wr->blocks[block].levels;
+      if(fwrite(entry, sizeof(entry), 1, wr->fp) != 1)
+         err = -1;
+   }
+
+   if(!err)
+      err = writeheader(wr, index);
+   if(fclose(wr->fp))
+      err = -1;
+
+   free(wr->blocks);
+   memset(wr, 0, sizeof(*wr));
+   return(err);
+}
+
+/**
+ * rft_parsepin
+ * @brief Convert a pin name ("P1.6") in the pin code
+ *
+ * @param name pin name
+ * @param pin  pin code
+ * @return 0 if ok, -1 if the name is not valid
+ */
+int rft_parsepin(const char *name, uint8_t *pin)
+{
+   unsigned port, bit;
+   char extra;
+
+   if(sscanf(name, "P%u.%u%c", &port, &bit, &extra) != 2 ||
+      port < 1 || port > 2 || bit > 7)
+      return(-1);
+   *pin = RFT_PIN(port, bit);
+   return(0);
+}
+
+/**
+ * rft_pinname
+ * @brief Convert a pin code in the pin name
+ *
+ * @param pin  pin code
+ * @param name buffer, at least 8 characters
+ * @return None
+ */
+void rft_pinname(uint8_t pin, char *name)
+{
+   sprintf(name, "P%u.%u", RFT_PORT(pin), RFT_BIT(pin));
+}
@@ -0,0 +1,143 @@
+/**
+ *  @file rftrace.h
+ *  @brief Compact binary trace format for the RF input and PWM output edges
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details A trace is a list of edges (level changes) of a small number of
+ *  pins ("channels"), timestamped in timer ticks (0.01 ms for rf_motor).
+ *
+ *  File layout (all the multibyte fields are little endian)
+ *
+ *  Offset  Size  Description
+ *  0       4     Magic "RFTR"
+ *  4       1     Version (RFT_VERSION)
+ *  5       1     Number of channels (1..RFT_MAXCHAN)
+ *  6       2     Maximum number of events in a block
+ *  8       4     Tick duration in nSec (10000 for rf_motor)
+ *  12      4     Number of blocks
+ *  16      8     Offset of the block index
+ *  24      8     Total number of events
+ *  32      16    Channel table, 2 bytes per channel :
+ *                pin (port << 4 | bit, i.e. 0x16 = P1.6), initial level
+ *  48      ...   Blocks
+ *  ...     ...   Block index, RFT_INDEXSIZE bytes per block :
+ *                start time (8), offset (8), events (4), levels (1), pad (3)
+ *
+ *  Every event is a single varint (7 bits per byte, LSB first, bit 7 set
+ *  on every byte but the last) holding (delta << 3) | channel, where delta
+ *  is the number of ticks elapsed from the previous event of the block (from
+ *  the block start time for the first one).
+ *  An event toggles the level of its channel, so the levels are never stored
+ *  except for the channel table and the block index (levels at block start),
+ *  that allow to start decoding from any block.
+ *
+ *  The same layout is produced by the rf_motor capture dump, with a single
+ *  channel and a single block.
+ */
+#ifndef RFTRACE_H
+#define RFTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define RFT_MAGIC       "RFTR"
+#define RFT_VERSION     1
+#define RFT_MAXCHAN     8        /* Channels are coded on 3 bits */
+#define RFT_HEADERSIZE  48       /* Header plus channel table */
+#define RFT_INDEXSIZE   24       /* Size of a block index entry */
+#define RFT_BLOCKEVENTS 4096     /* Default number of events per block */
+#define RFT_TICKNS      10000    /* Default tick - 0.01 ms */
+
+#define RFT_PIN(port, bit)  (((port) << 4) | (bit))
+#define RFT_PORT(pin)       ((pin) >> 4)
+#define RFT_BIT(pin)        ((pin) & 0x0F)
+
+/*
+ *  Single edge
+ */
+typedef struct
+{
+   uint64_t time;                /* Absolute time in ticks */
+   uint8_t  channel;             /* Channel toggling */
+   uint8_t  level;               /* Level of the channel after the edge */
+} rft_event;
+
+/*
+ *  Block index entry (decoded)
+ */
+typedef struct
+{
+   uint64_t start;               /* Time base of the block */
+   uint64_t offset;              /* Offset of the first event */
+   uint32_t events;              /* Events in the block */
+   uint8_t  levels;              /* Channel levels at the block start */
+} rft_block;
+
+/*
+ *  Trace opened for reading - the file is memory mapped and never copied
+ */
+typedef struct
+{
+   const uint8_t *map;           /* Mapped file */
+   size_t   size;                /* Size of the mapping */
+   uint8_t  nchan;               /* Number of channels */
+   uint8_t  pin[RFT_MAXCHAN];    /* Channel to pin */
+   uint8_t  level[RFT_MAXCHAN];  /* Initial levels */
+   uint16_t blockevents;         /* Maximum events in a block */
+   uint32_t tickns;              /* Tick duration in nSec */
+   uint32_t nblocks;             /* Number of blocks */
+   uint64_t nevents;             /* Total number of events */
+   const uint8_t *index;         /* Block index (inside the mapping) */
+} rft_reader;
+
+/*
+ *  Iterator on the events of a trace
+ */
+typedef struct
+{
+   const rft_reader *rd;
+   const uint8_t *pos;           /* Next byte to decode */
+   const uint8_t *end;           /* End of the current block */
+   uint32_t block;               /* Current block */
+   uint32_t left;                /* Events left in the current block */
+   uint64_t time;                /* Time of the last event */
+   uint8_t  levels;              /* Current levels (bit per channel) */
+} rft_iter;
+
+/*
+ *  Trace opened for writing
+ */
+typedef struct
+{
+   FILE    *fp;
+   uint8_t  nchan;
+   uint8_t  pin[RFT_MAXCHAN];
+   uint8_t  level[RFT_MAXCHAN];
+   uint8_t  levels;              /* Current levels (bit per channel) */
+   uint16_t blockevents;
+   uint32_t tickns;
+   uint64_t offset;              /* Current file offset */
+   uint64_t time;                /* Time of the last event */
+   uint64_t nevents;
+   uint32_t inblock;             /* Events written in the current block */
+   rft_block *blocks;            /* Index, written at the end */
+   uint32_t nblocks;
+   uint32_t maxblocks;
+} rft_writer;
+
+int  rft_open(rft_reader *rd, const char *name);
+void rft_close(rft_reader *rd);
+void rft_getblock(const rft_reader *rd, uint32_t block, rft_block *blk);
+void rft_begin(const rft_reader *rd, rft_iter *it);
+int  rft_seek(const rft_reader *rd, rft_iter *it, uint64_t time);
+int  rft_next(rft_iter *it, rft_event *ev);
+
+int  rft_create(rft_writer *wr, const char *name, uint8_t nchan,
+                const uint8_t *pin, const uint8_t *level, uint32_t tickns);
+int  rft_edge(rft_writer *wr, uint64_t time, uint8_t channel, uint8_t level);
+int  rft_finish(rft_writer *wr);
+
+int  rft_parsepin(const char *name, uint8_t *pin);
+void rft_pinname(uint8_t pin, char *name);
+
+#endif
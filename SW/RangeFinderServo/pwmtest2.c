@@ -18,6 +18,21 @@
  *  Initially the one used will be P1.2 (the same used in pwmtest1).
  *  The goal is to have a PWM with 20 ms period and duty cycle with 256 steps
  *
+ *  Teach and replay
+ *  The jogging in INCREASE and DECREASE is recorded, frame by frame, in the
+ *  information flash segments D, C and B (192 bytes, the segment A keeps
+ *  the calibration data and is never touched). The first S2 press in
+ *  INCREASE or DECREASE starts a new recording, leaving DECREASE ends it,
+ *  so passing through the modes without jogging keeps the stored one. In
+ *  REPLAY every S2 press plays it again with the original timing (scaled
+ *  by REPLAY_SCALE). Holding S2 at the reset starts in REPLAY, the replay
+ *  starts at its release : the recording survives the power off.
+ *  The recording is : Pwm1_dc at the start (2 bytes), then
+ *    0rrrrrrr - r frames (1..127) without changes
+ *    1ddddddd - Pwm1_dc changed by d - 64 (-64..62), no time
+ *    11111111 - end (erased flash)
+ *  Erasing the segments stops the CPU, and so the PWM, for about 40 ms.
+ *
  *  Built with IAR Embedded Workbench Version: 3.40A
  */
 
@@ -30,6 +45,14 @@
 __interrupt void Timer_A (void);    /* Timer A0 interrupt service routine */
 void Init(void);                    /* Init LED */
 unsigned char testButton(unsigned char);
+void FlashErase(unsigned char *);   /* Flash management */
+void FlashWrite(unsigned char *, unsigned char);
+void RecStart(void);                /* Teach and replay */
+void RecPut(unsigned char);
+void RecFrames(unsigned short);
+void RecStop(void);
+void PlayStart(void);
+void PlayFrames(unsigned short);
 
 /*
  *  Global defines
@@ -49,6 +72,13 @@ unsigned char testButton(unsigned char);
 #define POSIT2          161      /* Ending value for positioning the arm */
 #define SPEED          3000         /* Delay (in Seconds) for the activation */
 
+#define REC_START     ((unsigned char *) 0x1000)  /* Info segment D */
+#define REC_LIMIT     ((unsigned char *) 0x10C0)  /* Info segment A - never */
+#define REC_SEGMENT   64         /* Info segment size */
+#define REC_END       0xFF       /* End of the recording (erased flash) */
+#define REC_MAXRUN    127        /* Frames of a run byte */
+#define REPLAY_SCALE  4          /* Replay speed, 4 = as recorded, 2 = twice faster, 8 = half */
+
 #define FALSE         0
 #define TRUE          1
 /*
@@ -63,6 +93,12 @@ unsigned char testButton(unsigned char);
 #define WAITINGDOWN   6
 #define INCREASE      7
 #define DECREASE      8
+#define REPLAY        9
+
+#define TEACH_OFF     0          /* Teach and replay modes */
+#define TEACH_REC     1
+#define TEACH_PLAY    2
+#define TEACH_FULL    3          /* Recording full, until DECREASE is left */
 
 /* I/O defines */
 
@@ -85,6 +121,15 @@ unsigned short Pwm1_dc;         /* PWM 1 output ducty cycle */
 unsigned short Pwm1_cn;         /* PWM 1 counter */
 unsigned char  Pwm1_State;      /* PWM 1 state machine */
 unsigned short Pwm1_delay;      /* Used for PWM 1 rekated delay */
+
+unsigned short FrameCount;      /* PWM frames - incremented by the timer */
+unsigned short FrameSeen;       /* Last FrameCount handled */
+unsigned char  Teach;           /* Teach and replay mode */
+unsigned char *RecPtr;          /* Next byte to write or read in flash */
+unsigned short RecDc;           /* Last Pwm1_dc recorded */
+unsigned short RecRun;          /* Frames without changes not yet written */
+unsigned char  PlayWait;        /* Frames left of the run playing */
+unsigned short PlayAcc;         /* Replay speed accumulator */
 /*
  *  Main entry file
  */
@@ -107,6 +152,9 @@ void main(void)
       *    POSITOLD  - pressing S2 the servo is positioned on one of the two work positions - no delay
       *    INCREASE - pressing S2 the duty cycle is increased by one
       *    DECREASE - pressing S2 the duty cycle is decreased by one
+      *               (the first press of the two starts the recording)
+      *    REPLAY - pressing S2 the jogging recorded in INCREASE and DECREASE
+      *             is played again
       */
      if(testButton(S1_BUTTON))    /* Check S1 pushbutton */
      {
@@ -134,7 +182,13 @@ void main(void)
               break;
 
            case DECREASE:
+              Pwm1_State = REPLAY;
+              RecStop();
+              break;
+
+           case REPLAY:
               Pwm1_State = RESET;
+              Teach = TEACH_OFF;
               break;
 
            case MOVINGUP:
@@ -207,15 +261,23 @@ void main(void)
               break;
               
            case INCREASE:
+              if(Teach == TEACH_OFF)
+                 RecStart();
               if(Pwm1_dc < PWM1_MAXSTEP)
                  Pwm1_dc +=1;
               break;
 
            case DECREASE:
+              if(Teach == TEACH_OFF)
+                RecStart();
               if(Pwm1_dc > 0)
                 Pwm1_dc -= 1;
               break;
 
+           case REPLAY:
+              PlayStart();
+              break;
+
            case MOVINGUP:      
               if(Pwm1_dc == Pwm1_reach)
                 Pwm1_State = POSIT;
@@ -250,6 +312,21 @@ void main(void)
         }
      }   
      
+     /*
+      *  Teach and replay, with the PWM frames passed since the last time
+      *  (the buttons test waits for the release)
+      */
+     if(FrameCount != FrameSeen)
+     {
+        unsigned short frames = FrameCount - FrameSeen;
+
+        FrameSeen += frames;
+        if(Teach == TEACH_REC)
+           RecFrames(frames);
+        else if(Teach == TEACH_PLAY)
+           PlayFrames(frames);
+     }
+
      /* 
       *  Debug !
       *  The servomotor has a very precise range :
@@ -302,6 +379,18 @@ void Init(void)
   Pwm1_dc = PWMINITIALVALUE;  /* Set default PWM 1 value */
   Pwm1_reach = PWMINITIALVALUE;
   Pwm1_State = RESET;
+  if(P2IN & BIT6)
+    Pwm1_State = REPLAY;      /* S2 held : replay at its release */
+
+  FrameCount = 0;
+  FrameSeen  = 0;
+  Teach      = TEACH_OFF;
+
+  /*
+   *  Flash timing generator from SMCLK (2 MHz) / 5 = 400 kHz
+   *  (must be 257 to 476 kHz)
+   */
+  FCTL2 = FWKEY + FSSEL_2 + FN2;
   
   /*
    *  Set Timer
@@ -357,6 +446,203 @@ unsigned char testButton(unsigned char button)
       return (FALSE);
 }
 
+/**
+ * FlashErase
+ * @brief Erase a flash segment
+ *
+ * The CPU is stopped until the end of the erase (about 12 ms), the
+ * interrupts are disabled because the vectors are in flash.
+ * The segment A is protected by LOCKA, never cleared here.
+ *
+ * @param seg address in the segment
+ * @return None
+ */
+void FlashErase(unsigned char *seg)
+{
+   _BIC_SR(GIE);
+   FCTL3 = FWKEY;               /* Unlock, LOCKA unchanged */
+   FCTL1 = FWKEY + ERASE;
+   *seg  = 0;                   /* Dummy write starts the erase */
+   FCTL1 = FWKEY;
+   FCTL3 = FWKEY + LOCK;
+   _BIS_SR(GIE);
+}
+
+/**
+ * FlashWrite
+ * @brief Write a byte in flash (already erased)
+ *
+ * @param addr address to write
+ * @param value byte to write
+ * @return None
+ */
+void FlashWrite(unsigned char *addr, unsigned char value)
+{
+   _BIC_SR(GIE);
+   FCTL3 = FWKEY;
+   FCTL1 = FWKEY + WRT;
+   *addr = value;
+   FCTL1 = FWKEY;
+   FCTL3 = FWKEY + LOCK;
+   _BIS_SR(GIE);
+}
+
+/**
+ * RecStart
+ * @brief Start a new recording
+ *
+ * Erase the segments D, C and B, then write the Pwm1_dc of the start.
+ *
+ * @param none
+ * @return None
+ */
+void RecStart(void)
+{
+   unsigned char *seg;
+
+   for(seg = REC_START; seg < REC_LIMIT; seg += REC_SEGMENT)
+      FlashErase(seg);
+
+   RecPtr = REC_START;
+   RecDc  = Pwm1_dc;
+   RecRun = 0;
+   Teach  = TEACH_REC;
+   RecPut((unsigned char) RecDc);
+   RecPut((unsigned char) (RecDc >> 8));
+   FrameSeen = FrameCount;
+}
+
+/**
+ * RecPut
+ * @brief Write the next byte of the recording
+ *
+ * When the segments are full the recording ends, the jogging goes on
+ * without a new one up to the end of DECREASE (RecStop).
+ *
+ * @param value byte to write
+ * @return None
+ */
+void RecPut(unsigned char value)
+{
+   if(RecPtr == REC_LIMIT)
+   {
+      Teach = TEACH_FULL;
+      return;
+   }
+   FlashWrite(RecPtr++, value);
+}
+
+/**
+ * RecFrames
+ * @brief Record the PWM frames passed
+ *
+ * The frames are counted in RecRun with the last Pwm1_dc recorded, a
+ * change writes the run then the difference.
+ *
+ * @param frames frames passed since the last call
+ * @return None
+ */
+void RecFrames(unsigned short frames)
+{
+   signed short delta = Pwm1_dc - RecDc;
+   signed short d;
+
+   RecRun += frames;
+   while(RecRun >= REC_MAXRUN && Teach == TEACH_REC)
+   {
+      RecPut(REC_MAXRUN);
+      RecRun -= REC_MAXRUN;
+   }
+
+   if(!delta)
+      return;
+
+   if(RecRun)
+      RecPut(RecRun);
+   RecRun = 0;
+
+   while(delta && Teach == TEACH_REC)
+   {
+      d = delta < -64 ? -64 : delta > 62 ? 62 : delta;
+      RecPut(0x80 | (d + 64));
+      delta -= d;
+   }
+   RecDc = Pwm1_dc;
+}
+
+/**
+ * RecStop
+ * @brief End the recording
+ *
+ * The last run is written, the erased flash after it is the end mark.
+ *
+ * @param none
+ * @return None
+ */
+void RecStop(void)
+{
+   if(Teach == TEACH_REC && RecRun)
+      RecPut(RecRun);
+   Teach = TEACH_OFF;
+}
+
+/**
+ * PlayStart
+ * @brief Play the recording from the start
+ *
+ * @param none
+ * @return None
+ */
+void PlayStart(void)
+{
+   if(REC_START[0] == REC_END && REC_START[1] == REC_END)
+      return;                   /* Nothing recorded */
+
+   Pwm1_dc   = REC_START[0] | (REC_START[1] << 8);
+   RecPtr    = REC_START + 2;
+   PlayWait  = 0;
+   PlayAcc   = 0;
+   Teach     = TEACH_PLAY;
+   FrameSeen = FrameCount;
+}
+
+/**
+ * PlayFrames
+ * @brief Play the recording for the PWM frames passed
+ *
+ * Every frame adds 4 to PlayAcc, every REPLAY_SCALE a recorded frame is
+ * played : the differences are applied, then the run is waited.
+ *
+ * @param frames frames passed since the last call
+ * @return None
+ */
+void PlayFrames(unsigned short frames)
+{
+   unsigned char value;
+
+   PlayAcc += frames << 2;
+   while(PlayAcc >= REPLAY_SCALE)
+   {
+      PlayAcc -= REPLAY_SCALE;
+
+      while(!PlayWait)
+      {
+         if(RecPtr == REC_LIMIT || *RecPtr == REC_END)
+         {
+            Teach = TEACH_OFF;
+            return;
+         }
+
+         value = *RecPtr++;
+         if(value & 0x80)
+            Pwm1_dc += (value & 0x7F) - 64;
+         else
+            PlayWait = value;
+      }
+      PlayWait--;
+   }
+}
+
 /**
  * Timer_A
  * @brief Timer A0 interrupt service routine
@@ -396,6 +682,7 @@ __interrupt void Timer_A( void )
      */
     Pwm1_cn = 0;
     PWM1_OFF;   
+    FrameCount++;
   }  
 
 }
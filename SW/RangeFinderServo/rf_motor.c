@@ -14,35 +14,219 @@
  *  The PWM is generated via an interrupt function triggered by the timer.
  *  Is NOT used the PWM capability of the timer.
  *
+ *  The main loop is event driven : the interrupt routines post events
+ *  (EV_xxx) in a small queue and wake up the CPU, the main loop runs the
+ *  handlers of every event to completion then sleeps in LPM0 until the
+ *  next one. Nothing is polled.
+ *
+ *  The pushbutton, the RF remote and (in future) the serial line are
+ *  command sources : their commands pass through an arbiter (CmdPost) that
+ *  drops the repeated ones, orders the others by source priority in a
+ *  single small queue and lets a STOP preempt everything.
+ *  The arm runs moves (target, speed, dwell) from a second small queue :
+ *  when a move ends the next one starts in the same step, without gaps.
+ *
+ *  Motion script
+ *  Defining RF_SCRIPT the arm runs, from the power on, the motion script
+ *  Script (bytecode in flash, see rf_script.h) : the interpreter fills the
+ *  move queue every step, so the script costs nothing while the arm moves.
+ *  A STOP ends the script.
+ *  The script built by SW/Host/rfchoreo is used instead of the one in this
+ *  file defining RF_SCRIPT_FILE as its name, i.e. RF_SCRIPT_FILE="wave.h".
+ *
+ *  Second axis
+ *  Defining RF_AXIS2 a second servo is driven on P1.1 (Pwm2_dc). A move
+ *  can give a target to both axes (MovePost2, OP_MOVE2) : the axis with the
+ *  longest way steps at the move speed, the other one is interpolated
+ *  (DDA), so both start and arrive together.
+ *
+ *  RC receiver input
+ *  Defining RF_RCINPUT P1.6 takes the channel output of a hobby RC receiver
+ *  instead of the RF tone : the width of every pulse (1 - 2 ms, 10 us
+ *  steps) is measured on its edges (Port1_isr) and mapped on Pwm1_dc by
+ *  RcMap, through a deadband around the stick center and the curve RcCurve.
+ *  The arm follows the stick one frame late, when no move is running.
+ *
+ *  IR remote input
+ *  Defining RF_IRINPUT P1.6 takes the output of an IR receiver module
+ *  (TSOP type, low while the carrier is received) : the NEC and RC-5
+ *  frames are decoded edge by edge in the P1.6 interrupt (IrEdge) and
+ *  their address and command are looked up in IrKeys. A known key posts
+ *  its command to the arbiter, as the IR source : the presets (CMD_PRESET)
+ *  move the arm to the positions in Preset. The keys kept pressed are
+ *  sent once (NEC repeat frames, RC-5 toggle bit).
+ *
+ *  RF packets
+ *  Defining RF_PACKET the RF remote sends packets (address, command,
+ *  CRC-8, see rf_packet.h) instead of the tone : they are decoded edge by
+ *  edge in the P1.6 interrupt (PktEdge), so nothing runs at every tick.
+ *  A packet with the right CRC, for RfAddr or PKT_BROADCAST, posts its
+ *  command to the arbiter as the RF source. So many devices can share a
+ *  channel, and every command is checked.
+ *
+ *  RF gestures
+ *  Defining RF_GESTURE the presses of the RF remote make gestures :
+ *  single, double, triple press or a long press (GESTURE_LONG ms). The
+ *  presses of a gesture are apart less than GESTURE_GAP ms. Every gesture
+ *  posts its command (GestureCmd), i.e. a preset or the motion script.
+ *  The gestures are counted by RfConfirm on the CmdClock timestamps of the
+ *  presses and ended by its timers, nothing more is polled.
+ *
+ *  RF hold to move
+ *  Defining RF_HOLD the arm moves while the RF remote is kept pressed and
+ *  stops as soon as the detector loses the signal (EV_RFOFF, within one
+ *  tone period), so it can be placed anywhere. Every press moves the other
+ *  way of the previous one, or away from the end where the arm stays.
+ *
+ *  RF link quality
+ *  Defining RF_LINKQ every RF press (session) is checked at its end : the
+ *  valid periods received (LinkSeen) are compared with the periods of the
+ *  tone in the same time (LinkExpected). A session with less than
+ *  LINK_MINPCT % (LinkQuality) is degraded, i.e. a remote with a dying
+ *  battery : its command is dropped and the failsafe action is taken,
+ *  LINK_PARK (the arm goes to POSIT_START) or LINK_FREEZE (it stays where
+ *  it is). LinkBad counts the degraded sessions. The Link variables are
+ *  kept for diagnostics (debugger watch, rfsim).
+ *  The dropouts shorter than LINK_WAITEND ms stay in the session (without
+ *  RF_LINKQ every dropout longer than WAITEND_RF ends the press), so they
+ *  lower its quality instead of making many short presses. The RF_HOLD
+ *  presses end at the first period lost and are not checked.
+ *
+ *  Device address
+ *  The address of the device (RfAddr) is DEVICE_ADDR, plus 1 if
+ *  RF_ADDR_STRAP is defined and P2.7 is strapped high. With packets it is
+ *  the packet address, with the tone it selects the tone accepted (see
+ *  rf_packet.h) : the length of every half period is counted as before
+ *  and only checked at its end, so the address costs nothing per tick.
+ *  The broadcast tone and packets are accepted by every device.
+ *
+ *  Decimated RF detection
+ *  A half period of the tone is hundreds of ticks, so defining RF_DECIM
+ *  the detector samples P1.6 once every RF_DECIM ticks : its counts and
+ *  limits are in samples (RF_SAMPLE_US), so the tone tolerance is the
+ *  same. The sampling slot restarts at every P1.6 rise (Port1_isr), so
+ *  the counts are aligned on the edge and the other RF_DECIM - 1 ticks
+ *  only decrement RfDecim.
+ *
+ *  Goertzel tone detector
+ *  The half period detector gives up at the first glitch. Defining
+ *  RF_GOERTZEL P1.6 is sampled every ms instead (no P1.6 interrupt) and
+ *  the main loop runs the Goertzel filter of the device tone and of the
+ *  broadcast tone on blocks of GZ_N samples (GzRun) : the tone is detected
+ *  when the power of one of the bins is over GZ_THRESHOLD, so some noise
+ *  or a few periods lost only lower it. The filter is in 16 bits, Q14
+ *  coefficients (GzCoeffs, 2 cos(2 pi k / GZ_N), k = tone Hz / 10), only
+ *  the power of the block is in 32 bits. The detection comes one block
+ *  (100 ms) late, the end one or two blocks late.
+ *
+ *  Timer_A slots
+ *  Timer_A has CCR0 and CCR1 only. CCR0 makes the .01 ms tick in up mode,
+ *  so CCR1 cannot time anything longer than a tick (no 20 ms PWM, no bit
+ *  of the serial) and P1.6 is not one of its capture inputs : every
+ *  function shares the CCR0 tick instead, each one in its slot of the PWM
+ *  frame (Pwm1_cn) :
+ *
+ *  Slot                        Pwm1_cn               Functions
+ *  PWM edges                   0 .. PWM1_WINDOW - 1  PWM1, PWM2 pulses
+ *  Gap                         PWM1_WINDOW .. end    Serial TX bytes
+ *                                                    (RF_TXSLOT)
+ *  Every tick                                        RF detector, capture,
+ *                                                    delays
+ *
+ *  Defining RF_TXSLOT the serial (P1.5, TX_BAUD) is sent by Timer_A
+ *  instead of serial.c : TxPut queues the characters, a byte starts only
+ *  in the gap, if it ends before the frame, and its bit times come from
+ *  the tick (TX_BITQ8, fractional). So the serial never shares a tick
+ *  with a PWM edge and the RF_CAPTURE dump runs with the interrupts on,
+ *  the PWM goes on. TxPut never waits : Timer_A posts EV_TXDONE when it
+ *  takes the last character of the queue, the dump goes on from there
+ *  (CapSent), so the main loop keeps dispatching the events meanwhile.
+ *  The slots are checked at compile time (#error).
+ *
+ *  Nested interrupts
+ *  The interrupts do not nest on the MSP430 : Timer_A waits for the end of
+ *  the port routines, so a long one delays the PWM edges. The P1.6 edge
+ *  decoders (RF_IRINPUT, RF_PACKET) are the long ones : defining RF_NESTED
+ *  Port1_isr only takes the edge (level, next edge, time in EdgeNow) with
+ *  the interrupts off, then masks P1.6 and runs the decoder with the
+ *  interrupts on, so Timer_A preempts it. Port2_isr and the tone and RC
+ *  paths of Port1_isr are a few instructions, they stay as they are.
+ *  EvPost saves and restores the interrupt state, it is called also from
+ *  the preemptible part. An edge coming meanwhile waits in P1IFG.
+ *  So a PWM edge waits at most for the entry of Port1_isr instead of the
+ *  whole decoder. The latency is not measured : rfsim runs the routines
+ *  in zero time.
+ *  RF_NESTED is for RF_PACKET only : with RF_IRINPUT the globals and the
+ *  stack of the preempted decoder do not fit in RAM (#error).
+ *
+ *  State snapshot
+ *  Every variable of Timer_A can be read alone (16 bits, one instruction),
+ *  but not a few of them together : the timer can come in the middle.
+ *  Defining RF_SNAPSHOT Timer_A counts its runs in SnapSeq, SnapRead copies
+ *  the fields of struct Snap and does it again if SnapSeq changed
+ *  meanwhile (sequence lock), up to SNAP_TRIES times. So the main loop
+ *  gets a consistent copy without disabling the interrupts, the PWM timing
+ *  is not touched.
+ *  The copy is sent as telemetry every SNAP_PERIOD ms (EV_SNAPSHOT, a
+ *  copy not consistent in SNAP_TRIES is skipped) : the fields are queued
+ *  on the RF_TXSLOT serial, low byte first (SNAP_SIZE bytes), like the
+ *  capture dump it goes on at every EV_TXDONE. So
+ *  RF_SNAPSHOT needs RF_TXSLOT and leaves its queue to the telemetry (no
+ *  RF_CAPTURE).
+ *
  *  The timer will be set in UP mode (i.e. counting up to the value in CCR0).
  *  The timer will generate an interrupt every .01 ms
  *  Internal management (SW counter) will generate the PWM outputs.
  *
  *  Pinout  PCB Pin   Mode  Description
  *  P1.0      P2      Out   Debug LED - general purpose
- *  P1.1      P3      Out   Unused                                   
+ *  P1.1      P3      Out   PWM2 output - second servo (RF_AXIS2)
  *  P1.2      P4      Out   PWM1 output - servomotr control
  *  P1.3      P5      Out   Unused
  *  P1.4      P6      SMCLK Debug - report the SMCLK frequency
  *  P1.5      P7      Out   Test - indicate a RF detection
  *  P1.6      P8      In    Remote Input - signal from RF receiver
+ *                            (RC receiver channel with RF_RCINPUT,
+ *                            IR receiver with RF_IRINPUT)
  *  P1.7      P9      Out   Unused
- *  P2.6      P13     In    Pushbutton S1
- *  P2.7      P12     In    Unused
+ *  P2.6      P13     In    Pushbutton S1 (interrupt)
+ *  P2.7      P12     In    Address strap (RF_ADDR_STRAP), else unused
+ *
+ *  RF capture (debug)
+ *  Defining RF_CAPTURE every edge of P1.6 is timestamped in a small RAM
+ *  ring (delta encoded, see CaptureEdge). The ring is frozen CAPTURE_POST
+ *  edges after a RF detection and dumped on P1.5 (the TEST pin, used as
+ *  serial TX by serial.c at 9600 baud) in the host trace format
+ *  (SW/Host/rftrace.h), so it can be replayed on the PC with rfsim.
+ *  serial.c must be added to the project when RF_CAPTURE is defined.
+ *  A press is dumped once : the capture is triggered again only after the
+ *  RF is lost. The ring takes what is left of the RAM budget :
+ *  CAPTURE_SIZE bytes, about 2 bytes per edge of a tone, and the command
+ *  and move queues are shortened to 2 entries in this build. So
+ *  RF_CAPTURE is useful with the other options off : 16 bytes hold about
+ *  8 edges (4 before the trigger). With RF_TXSLOT too the ring shrinks to
+ *  8 bytes (4 edges, 2 before) and the TX queue to 2 characters (the dump
+ *  refills it at every EV_TXDONE), the other options do not fit (#error).
+ *
+ *  RAM budget
+ *  The MSP430F2012 has 128 bytes of RAM for the globals and the stack.
+ *  The globals of the base firmware and of every option are counted in
+ *  RAM_BASE and RAM_xxx (keep them up to date with the variables), the
+ *  stack in STACK_xxx, estimated from the code, not measured :
+ *  main - Dispatch - RfConfirm - CmdPost - CmdNext - MovePost - Motion -
+ *  FsmStep - action is 8 return addresses and about 2 saved registers
+ *  (20 bytes), Timer_A on top of it saves PC, SR and R12 - R15 and calls
+ *  EvPost (14 bytes). CaptureEdge (RF_CAPTURE) and GzRun (RF_GOERTZEL) add
+ *  a call, with RF_NESTED the P1.6 routine and its decoder stay below
+ *  Timer_A. The build stops (#error) if the globals and the stack of the
+ *  options selected do not fit.
  *
  *  Built with IAR Embedded Workbench Version: 3.40A
  */
 
 #include <string.h>
 #include "msp430x20x2.h"
-
-/*
- *  Functions prototype
- */
-__interrupt void Timer_A (void);    /* Timer A0 interrupt service routine */
-__interrupt void Port1_isr(void);       /* Port 1 I/O interrupt */
-void Init(void);                    /* Init LED */
-unsigned char testButton(unsigned char);
+#include "rf_script.h"
 
 /*
  *  Global defines
@@ -62,15 +246,23 @@ unsigned char testButton(unsigned char);
 #define POSIT_END       78      /* Ending value for positioning the arm */
 #define SPEED           3000     /* Delay for the activation (see note) */
 
-#define COUNTHIGH       625     /* Values to recognize a frequency */
-#define COUNTLOW        624
-#define COUNTOLER       10        /* Tolerance on the signal (+/-) */
+#define DEVICE_ADDR     0        /* Device address (tone or packet) */
+//#define RF_ADDR_STRAP            /* P2.7 high adds 1 to DEVICE_ADDR */
+#define RF_BCASTMIN     (TONE_BCAST_US / RF_SAMPLE_US - \
+                         TONE_BCAST_US / (16 * RF_SAMPLE_US))
+#define RF_HALFMAX      (TONE_BCAST_US / RF_SAMPLE_US + \
+                         TONE_BCAST_US / (16 * RF_SAMPLE_US))
+                                 /* Broadcast tone, +/- 1/16 - samples */
+//#define RF_DECIM        10       /* RF detector sample every 10 ticks */
 
 #define VALIDATE_RF     10       /* Validate delay - long delay - .01 sec */
 #define WAITEND_RF      10       /* Validate delay - long delay - .01 sec */
 #define IGNORE_RF       1000     /* ms when the signal must be ignore = 1 s */
 
 #define PRESCALER       100      /* Value to obtain a 1 ms timing */
+#define DEBOUNCE        20       /* Pushbutton debounce - ms */
+#define CMD_WINDOW      1500     /* Same command, same source ignored - ms */
+#define DWELL_TICK      1000     /* Dwell unit - .01 ms steps = 10 ms */
 /*
  *  Note about the SPEED define.
  *  This define is used to load a counter, decremented in the timer interrupt.
@@ -79,25 +271,245 @@ unsigned char testButton(unsigned char);
  *  decrement of the duty cycle.
  *  The SPEED value is multiplied fo .01 mS, so : 3000 * 0.01 ms = 0.03 Sec
  */
+//#define RF_CAPTURE               /* Capture P1.6 edges (debug) */
+#define CAPTURE_POST    (CAPTURE_SIZE / 4) /* Edges after the trigger */
+
+//#define RF_TXSLOT                /* Serial TX by Timer_A, PWM gap */
+#define TX_BAUD         9600
+#define PWM1_WINDOW     200      /* Slot of the PWM edges - Pwm1_cn */
+
+#if defined(RF_CAPTURE) && defined(RF_TXSLOT)
+#define CAPTURE_SIZE    8        /* Capture ring size in bytes - RAM budget */
+#define TX_SIZE         2        /* TX queue - power of 2, RAM budget */
+#else
+#define CAPTURE_SIZE    16       /* Capture ring size in bytes (RAM) */
+#define TX_SIZE         8        /* TX queue - power of 2 */
+#endif
+
+//#define RF_SCRIPT                /* Run the motion script */
+#define SCRIPT_OPS      8        /* Max operations run at every step */
+
+//#define RF_AXIS2                 /* Second servo on P1.1 */
+#define AXIS_HOLD       0xFF     /* Move target - axis not moved */
+
+//#define RF_GESTURE               /* RF press gestures */
+#define GESTURE_GAP     400      /* Max pause between two presses - ms */
+#define GESTURE_LONG    1000     /* Long press - ms */
+#define GESTURE_MAX     3        /* Presses of the longest gesture */
+#define GESTURE_HOLD    4        /* RfPresses of a long press */
+
+//#define RF_HOLD                  /* Move while the RF remote is pressed */
+
+//#define RF_LINKQ                 /* RF link quality and failsafe */
+#define LINK_MINPCT     75       /* Min periods seen / expected - % */
+#define LINK_PARK       1        /* Failsafe : move to POSIT_START */
+#define LINK_FREEZE     2        /* Failsafe : stop where it is */
+#define LINK_FAILSAFE   LINK_PARK
+#define LINK_WAITEND    50       /* Dropouts kept in the session - ms */
+
+//#define RF_RCINPUT               /* RC receiver pulse on P1.6 */
+#define RC_PULSEMIN     80       /* Valid pulse - .01 ms */
+#define RC_PULSEMAX     230
+#define RC_MIN          86       /* Pulse mapped on RcCurve[0] - .01 ms */
+#define RC_SEGSHIFT     4        /* RcCurve segment = 16 * .01 ms */
+#define RC_SEGMENTS     8        /* RcCurve span = 86 .. 214 */
+#define RC_CENTER       150      /* Stick center - .01 ms */
+#define RC_DEADBAND     3        /* Center deadband (+/-) - .01 ms */
+#define RC_HYST         1        /* Pwm1_dc changes smaller are ignored */
+
+//#define RF_IRINPUT               /* IR remote (NEC, RC-5) on P1.6 */
+#define IR_KEYS         13       /* Entries in IrKeys */
+
+//#define RF_PACKET                /* RF packets instead of the tone */
+
+//#define RF_GOERTZEL              /* Goertzel tone detector */
+#define GZ_N            100      /* Samples per block, one per ms */
+#define GZ_AMPL         32       /* Sample value, +/- */
+#define GZ_THRESHOLD    1000000L /* Bin power of the tone (clean 4000000) */
+#define GZ_BCAST_COEFF  30467    /* Broadcast tone, k = 6 */
+
+#include "rf_packet.h"              /* After RF_PACKET, for PktCrc8 */
+
+#if defined(RF_RCINPUT) + defined(RF_IRINPUT) + defined(RF_PACKET) + \
+    defined(RF_GOERTZEL) > 1
+#error "Only one of RF_RCINPUT, RF_IRINPUT, RF_PACKET, RF_GOERTZEL : all use P1.6"
+#endif
+
+#if defined(RF_GOERTZEL) && (defined(RF_DECIM) || defined(RF_LINKQ))
+#error "RF_DECIM and RF_LINKQ are for the half period detector, not RF_GOERTZEL"
+#endif
+
+#if defined(RF_HOLD) && defined(RF_GESTURE)
+#error "Only one of RF_HOLD, RF_GESTURE : both time the RF presses"
+#endif
+
+#if defined(RF_LINKQ)
+#define RF_WAITEND      LINK_WAITEND
+#elif defined(RF_GOERTZEL)
+#define RF_WAITEND      (GZ_N + 10)  /* A block without the tone */
+#else
+#define RF_WAITEND      WAITEND_RF
+#endif
+
+/*
+ *  Timer_A slots - ticks per bit in 1/256 (SMCLK 16 MHz), a byte is
+ *  start, 8 data and stop bits
+ */
+#define TX_BITQ8        (16000000L * 256 / (TX_BAUD * (TMRVALUE + 1L)))
+#define TX_BYTE_TICKS   ((TX_BITQ8 * 10 + 255) / 256)
+#if POSIT_START >= PWM1_WINDOW || PWMINITIALVALUE >= PWM1_WINDOW
+#error "The PWM pulses must end in their slot : PWM1_WINDOW too small"
+#endif
+#if defined(RF_TXSLOT) && PWM1_WINDOW + TX_BYTE_TICKS > PWM1_MAXSTEP
+#error "RF_TXSLOT : a byte does not fit in the PWM gap"
+#endif
+#if defined(RF_TXSLOT) && (TX_SIZE & (TX_SIZE - 1))
+#error "TX_SIZE must be a power of 2"
+#endif
+
+#ifdef RF_DECIM
+#if RF_DECIM < 2 || RF_DECIM > 16
+#error "RF_DECIM 2 .. 16 : the tone tolerance is 1/16 of a half period"
+#endif
+#define RF_SAMPLE_US    (10 * RF_DECIM)
+#else
+#define RF_SAMPLE_US    10       /* Detector sample - us */
+#endif
+
+#ifdef RF_ADDR_STRAP
+#define DEVICE_ADDRMAX  (DEVICE_ADDR + 1)
+#else
+#define DEVICE_ADDRMAX  DEVICE_ADDR
+#endif
+#if !defined(RF_PACKET) && DEVICE_ADDRMAX >= TONE_ADDRS
+#error "DEVICE_ADDR has no tone (with RF_ADDR_STRAP, DEVICE_ADDR + 1)"
+#endif
+
+#if defined(RF_IRINPUT) || defined(RF_PACKET)
+#define RF_EDGETIME              /* P1.6 edges timed by EdgeTicks */
+#endif
+//#define RF_NESTED                /* RF_PACKET decoder preemptible by Timer_A */
+
+//#define RF_SNAPSHOT              /* Consistent copy of Timer_A state */
+#define SNAP_PERIOD     1024     /* Telemetry record - ms, power of 2 */
+#define SNAP_TRIES      4        /* Copies tried by SnapRead */
+
+#if defined(RF_SNAPSHOT) && (!defined(RF_TXSLOT) || defined(RF_CAPTURE))
+#error "RF_SNAPSHOT sends on the RF_TXSLOT queue, without RF_CAPTURE"
+#endif
+#if defined(RF_SNAPSHOT) && (SNAP_PERIOD & (SNAP_PERIOD - 1))
+#error "SNAP_PERIOD must be a power of 2"
+#endif
+#if defined(RF_NESTED) && !defined(RF_PACKET)
+#error "RF_NESTED is for the RF_PACKET decoder (RF_IRINPUT does not fit in RAM)"
+#endif
+#define EDGE_GAP        15       /* No edge for so long - frame end - ms */
+
 #define FALSE         0
 #define TRUE          1
 /*
  *  State machine states
  */
 #define POSIT         0
-#define MOVINGUP      1
-#define MOVINGDOWN    2
-#define WAITINGUP     3
-#define WAITINGDOWN   4
+#define WAITINGUP     1
+#define WAITINGDOWN   2
+#define MOTION_STATES 3
+
+/*
+ *  Half period of the tone of this device or of the broadcast one -
+ *  checked at the end of every half period
+ */
+#ifdef RF_HOLD
+#define RF_DETRUN         TRUE
+#else
+#define RF_DETRUN         (Pwm1_State == POSIT)
+#endif
+#ifdef RF_DECIM
+#define RF_DETSLOT        (RfDecim ? (RfDecim--, FALSE) : \
+                                     (RfDecim = RF_DECIM - 1, TRUE))
+#else
+#define RF_DETSLOT        TRUE
+#endif
+#define RF_HALF_VALID(n)  (((n) >= RfToneMin && (n) <= RfToneMax) || \
+                           (n) >= RF_BCASTMIN)
 
 #define IDLE          0
 #define DETHIGH       1
 #define DETLOW        2
 #define DETEND        3
 
-#define VALIDATE      1
-#define WAITDETEND    2
-#define IGNORE        3
+/*
+ *  Table driven state machines
+ *  Every table has an entry for every state and event, the dispatch is a
+ *  single index in the table (in flash).
+ *  The action, if present, returns the branch (0..FSM_BRANCHES - 1) that
+ *  selects the next state, FSM_STAY keeps the current one, FSM_NONE marks
+ *  the branches the action never returns.
+ */
+#define FSM_BRANCHES  3
+#define FSM_STAY      0xFF
+#define FSM_NONE      0xFE
+
+struct FsmTrans
+{
+   unsigned char (*action)(void);           /* Action, NULL = none */
+   unsigned char next[FSM_BRANCHES];        /* Next state by branch */
+};
+
+#define FSM_IGNORE              { 0, { FSM_STAY, FSM_NONE, FSM_NONE } }
+#define FSM_GO(act, s)          { act, { s, FSM_NONE, FSM_NONE } }
+#define FSM_IF(act, s0, s1)     { act, { s0, s1, FSM_NONE } }
+#define FSM_CASE(act, s0, s1, s2) { act, { s0, s1, s2 } }
+
+unsigned char FsmStep(const struct FsmTrans *, unsigned char);
+#define FSM_DISPATCH(table, state, event) \
+   (state) = FsmStep(&(table)[state][event], state)
+
+/*
+ *  Stackless coroutines
+ *  A coroutine is a function called for every event it has to handle : it
+ *  runs until the next wait, then returns. Its position is kept in a 2 bytes
+ *  variable (the source line of the wait), the switch jumps back there at
+ *  the next call, so the sequence is written as plain code.
+ *  CO_WAIT_UNTIL checks the condition at once, CO_WAIT_NEXT only from the
+ *  next call.
+ *  The local variables are lost at every wait, no switch statement can be
+ *  used inside the coroutine body.
+ *  The case labels are entered only from the switch (if(0) around the one
+ *  of CO_WAIT_UNTIL), the code never falls through them.
+ */
+#define CO_BEGIN(lc)            switch(lc) { case 0:
+#define CO_WAIT_UNTIL(lc, cond) do { (lc) = __LINE__; \
+                                     if(0) { case __LINE__: ; } \
+                                     if(!(cond)) return; } while(0)
+#define CO_WAIT_NEXT(lc, cond)  do { (lc) = __LINE__; return; case __LINE__: \
+                                     if(!(cond)) return; } while(0)
+#define CO_END(lc)              } (lc) = 0
+
+/*
+ *  RF confirmation waits - to be used only in RfConfirm
+ *  RF_AWAIT_EVENT waits until cond is true (checked at once, then at every
+ *  event), RF_AWAIT_MS waits ms milliseconds (RfLongDelay), or less if cond
+ *  comes true at one of the next events.
+ */
+#define RF_AWAIT_EVENT(cond)    CO_WAIT_UNTIL(RfConfirmLc, cond)
+#define RF_AWAIT_MS(ms, cond)   do { RfLongDelay = (ms); \
+                                     CO_WAIT_NEXT(RfConfirmLc, \
+                                        event == EV_RFTIMER || (cond)); \
+                                } while(0)
+
+/*
+ *  RF link quality - a session starts with LINK_START, LINK_OK ends it
+ *  and is FALSE if the failsafe was taken
+ */
+#ifdef RF_LINKQ
+#define LINK_START              do { LinkSeen = 0; LinkStamp = CmdClock; \
+                                } while(0)
+#define LINK_OK(tail)           LinkCheck(tail)
+#else
+#define LINK_START
+#define LINK_OK(tail)           TRUE
+#endif
 
 /* I/O defines */
 
@@ -111,6 +523,9 @@ unsigned char testButton(unsigned char);
 #define PWM1_ON  P1OUT |= BIT2
 #define PWM1_OFF P1OUT &= ~BIT2
 
+#define PWM2_ON  P1OUT |= BIT1
+#define PWM2_OFF P1OUT &= ~BIT1
+
 /*
  *  Debug pins
  */
@@ -118,10 +533,287 @@ unsigned char testButton(unsigned char);
 #define TEST0_OFF P1OUT &= ~BIT3
 #define TEST0_TOGGLE P1OUT ^= BIT3
 
+#if !defined(RF_CAPTURE) && !defined(RF_TXSLOT)
 #define TEST_ON  P1OUT |= BIT5
 #define TEST_OFF P1OUT &= ~BIT5
 #define TEST_TOGGLE P1OUT ^= BIT5
+#else
+#define TEST_ON                   /* P1.5 is the serial TX */
+#define TEST_OFF
+#define TEST_TOGGLE
+#endif
+
+/*
+ *  Events
+ */
+#define EV_RFON       1           /* Valid RF period received */
+#define EV_RFOFF      2           /* RF signal lost */
+#define EV_RFTIMER    3           /* RfLongDelay expired */
+#define EV_BUTTON     4           /* S2 pushbutton pressed */
+#define EV_STEP       5           /* Pwm1_delay expired */
+#define EV_MOVE       6           /* Move added to MoveQueue (not queued) */
+#define EV_CAPTURE    7           /* Capture ring frozen */
+#define EV_RCPULSE    8           /* RC pulse measured (RcWidth) */
+#define EV_IRCODE     9           /* IR frame decoded (IrProto ..) */
+#define EV_PACKET     10          /* RF packet received (PktAddr ..) */
+#define EV_SAMPLES    11          /* 16 P1.6 samples taken (GzBlock) */
+#define EV_TXDONE     12          /* TX queue empty (TxPut) */
+#define EV_SNAPSHOT   13          /* Telemetry record due (SNAP_PERIOD) */
+
+#define MOTION_EVENTS 2           /* EV_STEP .. EV_MOVE */
+
+#define EVQ_SIZE      8           /* Event queue size - power of 2 */
+
+/*
+ *  Wake up the main loop, if something was posted, on exit of the
+ *  interrupt routine - to be used only in the interrupt routine itself
+ */
+#define EVWAKE  if(EvTail != EvHead) _BIC_SR_IRQ(LPM0_bits)
 
+/*
+ *  Commands and sources (see CmdPriority)
+ */
+#define CMD_TOGGLE    1           /* Move to the other position */
+#define CMD_UP        2           /* Move to POSIT_START */
+#define CMD_DOWN      3           /* Move to POSIT_END */
+#define CMD_STOP      4           /* Stop where it is (preempts) */
+#define CMD_SCRIPT    5           /* Run the motion script from the start */
+#define CMD_PRESET    8           /* + n : move to Preset[n] (n 0 .. 7) */
+
+#define SRC_RF        0
+#define SRC_SERIAL    1
+#define SRC_BUTTON    2
+#ifdef RF_IRINPUT
+#define SRC_IR        3
+#define CMD_SOURCES   4
+#else
+#define CMD_SOURCES   3
+#endif
+
+#define PRESETS       4           /* Entries in Preset */
+
+#if defined(RF_CAPTURE) || defined(RF_NESTED)
+#define CMDQ_SIZE     2           /* Command queue size - RAM budget */
+#define MOVEQ_SIZE    2           /* Move queue size - RAM budget */
+#else
+#define CMDQ_SIZE     4           /* Command queue size */
+#define MOVEQ_SIZE    4           /* Move queue size */
+#endif
+
+/*
+ *  RAM budget - bytes, see the note in the header
+ */
+#define RAM_SIZE      128         /* MSP430F2012 */
+#define RAM_BASE      (33 + EVQ_SIZE + CMDQ_SIZE + 3 * MOVEQ_SIZE + \
+                       3 * CMD_SOURCES)
+#define RAM_AXIS2     (13 + MOVEQ_SIZE)
+#define RAM_CAPTURE   (13 + CAPTURE_SIZE)
+#define RAM_TXSLOT    (7 + TX_SIZE)
+#define RAM_SNAPSHOT  12          /* SnapOut has a pad byte */
+#define STACK_BASE    34          /* Main loop calls and Timer_A */
+#define STACK_CAPTURE 6           /* CaptureEdge */
+#define STACK_GOERTZEL 6          /* GzRun */
+#define STACK_NESTED  16          /* Port1_isr and decoder below Timer_A */
+
+#if RAM_BASE + STACK_BASE + \
+    defined(RF_AXIS2) * RAM_AXIS2 + defined(RF_SCRIPT) * 5 + \
+    defined(RF_GESTURE) * 3 + defined(RF_HOLD) * 1 + \
+    defined(RF_LINKQ) * 9 + defined(RF_DECIM) * 1 + \
+    defined(RF_GOERTZEL) * (20 + STACK_GOERTZEL) + \
+    defined(RF_RCINPUT) * 4 + defined(RF_IRINPUT) * 11 + \
+    defined(RF_PACKET) * 9 + defined(RF_EDGETIME) * 8 + \
+    defined(RF_NESTED) * STACK_NESTED + defined(RF_SNAPSHOT) * RAM_SNAPSHOT + \
+    defined(RF_TXSLOT) * RAM_TXSLOT + \
+    defined(RF_CAPTURE) * (RAM_CAPTURE + STACK_CAPTURE) > RAM_SIZE
+#error "RAM : the globals and the stack of these options exceed RAM_SIZE"
+#endif
+
+/*
+ *  Arm move
+ */
+struct Move
+{
+   unsigned char target;          /* Pwm1_dc to reach */
+   unsigned char speed;           /* ms per step */
+   unsigned char dwell;           /* Stop at the target - DWELL_TICK units */
+#ifdef RF_AXIS2
+   unsigned char target2;         /* Pwm2_dc to reach, AXIS_HOLD = none */
+#endif
+};
+
+#ifdef RF_SNAPSHOT
+/*
+ *  Timer_A state, copied by SnapRead
+ */
+struct Snap
+{
+   unsigned short pwm_cn;         /* Pwm1_cn */
+   unsigned short pwm_delay;      /* Pwm1_delay */
+   unsigned short long_delay;     /* RfLongDelay */
+   unsigned short clock;          /* CmdClock */
+   unsigned char  detected;       /* RfDetected */
+};
+
+#define SNAP_SIZE     9           /* Telemetry record bytes (SnapSend) */
+#endif
+
+/*
+ *  Move ended
+ */
+#ifdef RF_AXIS2
+#define MOVE_DONE     (!DdaLeft)
+#else
+#define MOVE_DONE     (Pwm1_dc == Pwm1_reach)
+#endif
+
+/*
+ *  Script states
+ */
+#define SCRIPT_IDLE   0
+#define SCRIPT_RUN    1
+#define SCRIPT_WAITRF 2
+
+/*
+ *  IR decoder states
+ *  IR_RC5 + RC5_xxx are the states of the RC-5 Manchester decoder, at the
+ *  start or in the middle of a bit 0 or 1 (see Rc5Trans).
+ */
+#define IR_IDLE       0           /* Wait the first mark of a frame */
+#define IR_MARK       1           /* First mark running */
+#define IR_NEC_LEAD   2           /* NEC leader mark received */
+#define IR_NEC_BITS   3           /* NEC address and command bits */
+#define IR_RC5        4
+
+#define RC5_START1    0
+#define RC5_MID1      1
+#define RC5_MID0      2
+#define RC5_START0    3
+#define RC5_BITS      14          /* S1, S2, toggle, 5 address, 6 command */
+
+#define IR_NEC        0           /* IrProto */
+#define IR_RC5PROTO   1
+
+/*
+ *  IR timings - .01 ms, min and max
+ */
+#define IR_NEC_LEADMIN  800       /* Leader mark 9 ms */
+#define IR_NEC_LEADMAX  1000
+#define IR_NEC_HDRMIN   400       /* Leader space 4.5 ms (2.25 ms = repeat) */
+#define IR_NEC_HDRMAX   500
+#define IR_NEC_BITMIN   35        /* Bit mark, space of a 0 - .56 ms */
+#define IR_NEC_BITMAX   80
+#define IR_NEC_ONEMIN   140       /* Space of a 1 - 1.69 ms */
+#define IR_NEC_ONEMAX   200
+#define IR_RC5_SHORTMIN 60        /* Half bit .89 ms */
+#define IR_RC5_SHORTMAX 120
+#define IR_RC5_LONGMIN  140       /* Full bit 1.78 ms */
+#define IR_RC5_LONGMAX  220
+
+/*
+ *  Packet receiver states and timings (.01 ms) - the packet times in
+ *  rf_packet.h, 60 % .. 150 %
+ */
+#define PKT_HUNT      0           /* Wait preamble and sync */
+#define PKT_DATA      1           /* Bits */
+
+#define PKT_PREMIN    (PKT_PRE_US * 6 / 100)
+#define PKT_PREMAX    (PKT_PRE_US * 15 / 100)
+#define PKT_SYNCMIN   (PKT_SYNC_US * 6 / 100)
+#define PKT_SYNCMAX   (PKT_SYNC_US * 15 / 100)
+#define PKT_BITMIN    (PKT_SHORT_US * 6 / 100)
+#define PKT_BITMAX    (PKT_LONG_US * 15 / 100)
+#define PKT_BITSPLIT  ((PKT_SHORT_US + PKT_LONG_US) / 20)  /* Short < split */
+
+/*
+ *  Capture states
+ */
+#define CAP_RUN       0
+#define CAP_TRIGGER   1
+#define CAP_FROZEN    2
+#define CAP_SENT      3           /* Dumped, rearmed when the RF is lost */
+
+/*
+ *  RF lost - the next press triggers a new capture (Timer_A only)
+ */
+#ifdef RF_CAPTURE
+#define CAP_REARM     if(CapState == CAP_SENT) CapState = CAP_RUN
+#else
+#define CAP_REARM
+#endif
+
+/*
+ *  Capture dump - trace header and channel table, then the ring (a
+ *  single block), then the block index
+ */
+#define CAP_HEADER    48
+#define CAP_INDEX     24
+
+#define CAPF_ZERO     0           /* Dump field values (CapFields) */
+#define CAPF_ONE      1
+#define CAPF_MAGIC    2
+#define CAPF_EVENTS   3           /* CapEvents */
+#define CAPF_TICK     4
+#define CAPF_INDEX    5           /* Offset of the block index */
+#define CAPF_PIN      6
+#define CAPF_FIRST    7           /* CapFirst */
+#define CAPF_HEADER   8           /* Offset of the block */
+
+/*
+ *  Functions prototype
+ */
+__interrupt void Timer_A (void);    /* Timer A0 interrupt service routine */
+__interrupt void Port1_isr(void);       /* Port 1 I/O interrupt */
+__interrupt void Port2_isr(void);       /* Port 2 I/O interrupt */
+void Init(void);                    /* Init LED */
+void Dispatch(unsigned char);       /* Deliver an event to the handlers */
+void RfConfirm(unsigned char);      /* RF command validation */
+void Motion(unsigned char);         /* Arm movement */
+void CmdPost(unsigned char, unsigned char);  /* Command arbiter */
+void CmdNext(void);                 /* Start the next queued command */
+unsigned char MotionStep(void);     /* State machine action */
+unsigned char MovePost(unsigned char, unsigned char, unsigned char);
+#ifdef RF_LINKQ
+unsigned char LinkCheck(unsigned short);  /* Session quality, failsafe */
+#endif
+#ifdef RF_AXIS2
+unsigned char MovePost2(unsigned char, unsigned char, unsigned char,
+                        unsigned char);
+void DdaStep(unsigned short *, unsigned short, unsigned char);
+#endif
+#ifdef RF_SCRIPT
+void ScriptRun(void);               /* Motion script interpreter */
+#endif
+void EvPost(unsigned char);         /* Post an event (interrupt only) */
+#ifdef RF_RCINPUT
+void RcMap(void);                   /* RC pulse to Pwm1_dc */
+#endif
+#ifdef RF_IRINPUT
+void IrEdge(unsigned char);         /* IR decoder, P1.6 edge */
+void IrCommand(void);               /* IR key to command */
+#endif
+#ifdef RF_EDGETIME
+unsigned short EdgeTicks(void);     /* Time from the last P1.6 edge */
+#endif
+#ifdef RF_PACKET
+void PktEdge(unsigned char);        /* Packet receiver, P1.6 edge */
+void PktCommand(void);              /* Packet to command */
+#endif
+#ifdef RF_GOERTZEL
+void GzRun(void);                   /* Goertzel filter, 16 samples */
+#endif
+#ifdef RF_CAPTURE
+void CaptureEdge(void);
+void CaptureDump(void);
+#endif
+#ifdef RF_SNAPSHOT
+unsigned char SnapRead(struct Snap *); /* Consistent copy of Timer_A state */
+void SnapSend(void);
+#endif
+#ifdef RF_TXSLOT
+unsigned char TxPut(char);          /* Serial TX by Timer_A */
+#else
+void putch(char);                   /* serial.c */
+#endif
 
 /*
  *  Global variables
@@ -132,203 +824,1387 @@ unsigned short Pwm1_cn;         /* PWM 1 counter */
 unsigned char  Pwm1_State;      /* PWM 1 state machine */
 unsigned short Pwm1_delay;      /* Used for PWM 1 rekated delay */
 
-unsigned char RfDetState;       /* State machine for detection */
-unsigned short RfDetCounter;     /* Counter for RF detection */
-unsigned char RfDetected;       /* Flag to report the RF status 1= RF present */
-unsigned char RfDetConfirmSt;   /* Confirmation state */
-unsigned short RfPrescaler;     /* Prescaler for long delays */
-unsigned short RfLongDelay;     /* Counter for long delay - 1000 = 1 Sec. (1 ms - 65 sec) */
-unsigned short RfShortDelay;    /* Counter for short delay - 1000 = 0.01 Sec */
+unsigned char RfDetState;       /* State machine for detection */
+unsigned short RfDetCounter;     /* Counter for RF detection */
+unsigned char RfDetected;       /* Flag to report the RF status 1= RF present */
+unsigned short RfConfirmLc;     /* Confirmation coroutine position */
+unsigned char RfPrescaler;      /* Prescaler for long delays */
+unsigned short RfLongDelay;     /* Counter for long delay - 1000 = 1 Sec. (1 ms - 65 sec) */
+#ifdef RF_GESTURE
+unsigned char RfPresses;        /* Presses of the gesture, GESTURE_HOLD = long */
+unsigned short RfPressStart;    /* CmdClock at the last press confirmed */
+#endif
+#ifdef RF_HOLD
+unsigned char RfHoldCmd;        /* CMD_UP or CMD_DOWN of the last press */
+#endif
+#ifdef RF_LINKQ
+unsigned short LinkSeen;        /* Valid periods of the session */
+unsigned short LinkExpected;    /* Periods of the tone in the session */
+unsigned short LinkStamp;       /* CmdClock at the session start */
+unsigned char LinkQuality;      /* LinkSeen / LinkExpected of the last - % */
+unsigned char LinkBad;          /* Degraded sessions */
+unsigned char LinkBcast;        /* Last period of the broadcast tone */
+#endif
+unsigned char RfAddr;           /* Device address */
+#ifdef RF_DECIM
+unsigned char RfDecim;          /* Ticks to the next detector sample */
+#endif
+#ifdef RF_GOERTZEL
+unsigned short GzBits;          /* P1.6 samples, last in bit 0 - interrupt */
+unsigned char GzTaken;          /* Samples in GzBits - interrupt */
+unsigned short GzBlock;         /* 16 samples for GzRun */
+unsigned char GzCount;          /* Samples of the block filtered */
+short GzCoeff;                  /* Device tone coefficient - Q14 */
+short GzS1, GzS2;               /* Device tone filter state */
+short GzB1, GzB2;               /* Broadcast tone filter state */
+unsigned long GzPower;          /* Power of the last block, max bin */
+#endif
+unsigned short RfToneMin;       /* Half period of the device tone, min */
+unsigned short RfToneMax;       /* and max */
+
+
+unsigned char EvQueue[EVQ_SIZE];  /* Event queue */
+volatile unsigned char EvHead;  /* Next event to write - interrupts only */
+volatile unsigned char EvTail;  /* Next event to read - main loop only */
+unsigned char ButtonDelay;      /* Pushbutton debounce - ms */
+
+unsigned char CmdQueue[CMDQ_SIZE];  /* Commands, (source << 4) | command */
+unsigned char CmdCount;         /* Commands in the queue */
+unsigned short CmdClock;        /* Free running ms counter */
+unsigned short CmdStamp[CMD_SOURCES]; /* CmdClock of the last accepted command */
+unsigned char CmdLast[CMD_SOURCES];   /* Last accepted command */
+
+struct Move MoveQueue[MOVEQ_SIZE];  /* Moves to run */
+unsigned char MoveHead;         /* Next move to run */
+unsigned char MoveCount;        /* Moves in the queue */
+unsigned char MoveSpeed;        /* Running move - ms per step */
+unsigned char MoveDwell;        /* Running move - dwell left */
+
+#ifdef RF_AXIS2
+unsigned short Pwm2_reach;      /* PWM 2 position to reach */
+unsigned short Pwm2_dc;         /* PWM 2 output duty cycle */
+unsigned char MoveTarget2;      /* target2 of the next move posted */
+unsigned char DdaSteps;         /* Steps of the running move */
+unsigned char DdaLeft;          /* Steps left */
+unsigned char DdaDelta[2];      /* Steps of every axis */
+unsigned short DdaErr[2];       /* Interpolation error of every axis */
+#endif
+
+#ifdef RF_RCINPUT
+unsigned short RcRise;          /* Pwm1_cn at the pulse rise */
+unsigned short RcWidth;         /* Last pulse width - .01 ms */
+#endif
+
+#ifdef RF_IRINPUT
+unsigned char IrState;          /* IR decoder state */
+unsigned char IrBits;           /* NEC bits received, RC-5 bits left */
+unsigned long IrData;           /* Bits received */
+unsigned char IrProto;          /* Last frame - IR_NEC or IR_RC5PROTO */
+unsigned char IrAddr;           /* Last frame - address */
+unsigned char IrCmd;            /* Last frame - command */
+unsigned char IrToggle;         /* Last frame - RC-5 toggle bit */
+unsigned char IrLastToggle;     /* Toggle bit of the last RC-5 key used */
+#endif
+
+#ifdef RF_PACKET
+unsigned char PktState;         /* Packet receiver state */
+unsigned char PktBits;          /* Preamble edges, then bits received */
+unsigned long PktData;          /* Bits received */
+unsigned char PktAddr;          /* Last packet - address */
+unsigned char PktCmd;           /* Last packet - command */
+unsigned char PktCrc;           /* Last packet - CRC received */
+#endif
+
+#ifdef RF_EDGETIME
+unsigned short EdgeStamp;       /* Pwm1_cn at the last P1.6 edge */
+unsigned short EdgeClock;       /* CmdClock at the last P1.6 edge */
+unsigned short EdgeNow;         /* Pwm1_cn at this edge */
+unsigned short EdgeNowClock;    /* CmdClock at this edge */
+#endif
+
+#ifdef RF_SCRIPT
+unsigned char ScriptState;      /* Script interpreter state */
+unsigned char ScriptPc;         /* Offset of the next operation */
+unsigned char ScriptLoop;       /* Passes left of the running OP_LOOP */
+unsigned char ScriptTarget;     /* Target of the last move queued */
+unsigned char ScriptSpeed;      /* Speed of the last move queued */
+#endif
+
+/*
+ *  State machine tables
+ *
+ *  Arm movement - events EV_STEP, EV_MOVE
+ *    POSIT  - the servo is in position, waiting a move
+ *    WAITINGUP - moving up, wait for the next step
+ *    WAITINGDOWN - moving down, wait for the next step
+ */
+const struct FsmTrans MotionFsm[MOTION_STATES][MOTION_EVENTS] =
+{
+   {  /* POSIT */
+      FSM_IGNORE,                                            /* EV_STEP */
+      FSM_CASE(MotionStep, POSIT, WAITINGUP, WAITINGDOWN)    /* EV_MOVE */
+   },
+   {  /* WAITINGUP */
+      FSM_CASE(MotionStep, POSIT, WAITINGUP, WAITINGDOWN),
+      FSM_IGNORE
+   },
+   {  /* WAITINGDOWN */
+      FSM_CASE(MotionStep, POSIT, WAITINGUP, WAITINGDOWN),
+      FSM_IGNORE
+   }
+};
+
+/*
+ *  Command arbiter - priority of every source, the higher wins
+ */
+const unsigned char CmdPriority[CMD_SOURCES] =
+{
+   1,       /* SRC_RF */
+   2,       /* SRC_SERIAL */
+   3,       /* SRC_BUTTON */
+#ifdef RF_IRINPUT
+   1        /* SRC_IR */
+#endif
+};
+
+/*
+ *  Arm positions of the CMD_PRESET commands
+ */
+const unsigned char Preset[PRESETS] =
+{
+   POSIT_START, 133, 106, POSIT_END
+};
+
+#ifdef RF_GESTURE
+/*
+ *  Command of every gesture
+ */
+const unsigned char GestureCmd[GESTURE_HOLD] =
+{
+   CMD_TOGGLE,                  /* Single press */
+   CMD_PRESET + 1,              /* Double */
+   CMD_PRESET + 2,              /* Triple */
+#ifdef RF_SCRIPT
+   CMD_SCRIPT                   /* Long */
+#else
+   CMD_PRESET + 3
+#endif
+};
+#endif
+
+#ifdef RF_GOERTZEL
+/*
+ *  Goertzel coefficients of the device tones (rf_packet.h), Q14
+ */
+const short GzCoeffs[TONE_ADDRS] =
+{
+   28715,                       /* 80 Hz, k = 8 */
+   26510,                       /* 100 Hz, k = 10 */
+   23887,                       /* 120 Hz, k = 12 */
+   20887                        /* 140 Hz, k = 14 */
+};
+#endif
+
+#ifdef RF_IRINPUT
+/*
+ *  IR keys - protocol, address, command and the command posted.
+ *  NEC : the common 21 keys "Car MP3" remote, address 0.
+ *  RC-5 : any TV remote, address 0.
+ */
+struct IrKey
+{
+   unsigned char proto;
+   unsigned char addr;
+   unsigned char code;
+   unsigned char cmd;
+};
+
+const struct IrKey IrKeys[IR_KEYS] =
+{
+   { IR_NEC,      0x00, 0x43, CMD_TOGGLE },       /* Play / pause */
+   { IR_NEC,      0x00, 0x46, CMD_STOP },         /* CH */
+   { IR_NEC,      0x00, 0x47, CMD_UP },           /* CH+ */
+   { IR_NEC,      0x00, 0x45, CMD_DOWN },         /* CH- */
+   { IR_NEC,      0x00, 0x0C, CMD_PRESET + 0 },   /* 1 */
+   { IR_NEC,      0x00, 0x18, CMD_PRESET + 1 },   /* 2 */
+   { IR_NEC,      0x00, 0x5E, CMD_PRESET + 2 },   /* 3 */
+   { IR_NEC,      0x00, 0x08, CMD_PRESET + 3 },   /* 4 */
+   { IR_RC5PROTO, 0x00, 12,   CMD_STOP },         /* Standby */
+   { IR_RC5PROTO, 0x00, 1,    CMD_PRESET + 0 },   /* 1 */
+   { IR_RC5PROTO, 0x00, 2,    CMD_PRESET + 1 },   /* 2 */
+   { IR_RC5PROTO, 0x00, 3,    CMD_PRESET + 2 },   /* 3 */
+   { IR_RC5PROTO, 0x00, 4,    CMD_PRESET + 3 }    /* 4 */
+};
+
+/*
+ *  RC-5 decoder - next state by event, 2 bits each : short space (bits
+ *  1..0), short mark (3..2), long space (5..4), long mark (7..6).
+ *  The same state as the current one is an error.
+ */
+const unsigned char Rc5Trans[4] =
+{
+   0x01,    /* RC5_START1 */
+   0x91,    /* RC5_MID1 */
+   0x9B,    /* RC5_MID0 */
+   0xFB     /* RC5_START0 */
+};
+#endif
+
+#ifdef RF_RCINPUT
+/*
+ *  RC curve - Pwm1_dc at every RC_SEGMENTS step of the pulse from RC_MIN,
+ *  linear in between. Linear from POSIT_END to POSIT_START by default.
+ */
+const unsigned char RcCurve[RC_SEGMENTS + 1] =
+{
+   78, 88, 99, 109, 120, 130, 140, 151, 161
+};
+#endif
+
+#ifdef RF_SCRIPT
+#ifdef RF_SCRIPT_FILE
+#include RF_SCRIPT_FILE
+#else
+/*
+ *  Motion script - wait the remote, raise, pause, sweep three times,
+ *  lower, then again
+ */
+const unsigned char Script[] =
+{
+   SC_WAITRF,                   /*  0 */
+   SC_MOVE(POSIT_END, 10),      /*  1 - raise */
+   SC_WAIT(100),                /*  4 - pause 1 s */
+   SC_MOVE(120, 20),            /*  6 - sweep */
+   SC_MOVE(POSIT_END, 20),      /*  9 */
+   SC_LOOP(3, 6),               /* 12 */
+   SC_WAIT(50),                 /* 15 */
+   SC_MOVE(POSIT_START, 30),    /* 17 - lower */
+   SC_LOOP(0, 0)                /* 20 */
+};
+#endif
+#endif
+
+#ifdef RF_CAPTURE
+unsigned char CapRing[CAPTURE_SIZE];  /* Edges, varint (delta << 3) */
+unsigned char CapHead;          /* Next byte to write */
+unsigned char CapTail;          /* Oldest edge */
+unsigned char CapUsed;          /* Bytes used in the ring */
+unsigned char CapEvents;        /* Edges in the ring */
+unsigned char CapLevel;         /* Last P1.6 level sampled */
+unsigned char CapFirst;         /* P1.6 level before the oldest edge */
+unsigned char CapState;         /* Capture state */
+unsigned char CapPost;          /* Edges left to capture after the trigger */
+unsigned long CapDelta;         /* Ticks from the last edge */
+unsigned char CapSent;          /* Bytes of the dump sent */
+
+/*
+ *  Capture dump fields (trace header, channel table and block index, see
+ *  SW/Host/rftrace.h) : offset in the dump, the index ones without the
+ *  ring, and value (CAPF_xxx). A field lasts up to the next one, little
+ *  endian, the bytes past the value are 0.
+ */
+const unsigned char CapFields[][2] =
+{
+   { 0,  CAPF_MAGIC },          /* "RFTR" */
+   { 4,  CAPF_ONE },            /* Version */
+   { 5,  CAPF_ONE },            /* Channels */
+   { 6,  CAPF_EVENTS },         /* Events per block */
+   { 8,  CAPF_TICK },           /* Tick in nSec */
+   { 12, CAPF_ONE },            /* Blocks */
+   { 16, CAPF_INDEX },          /* Index offset */
+   { 24, CAPF_EVENTS },         /* Events */
+   { 32, CAPF_PIN },            /* Channel 0 is P1.6 */
+   { 33, CAPF_FIRST },
+   { 34, CAPF_ZERO },           /* Unused channels */
+   { 48, CAPF_ZERO },           /* Block start, the edge before the oldest */
+   { 56, CAPF_HEADER },         /* Block offset */
+   { 64, CAPF_EVENTS },
+   { 68, CAPF_FIRST },          /* Levels and padding */
+   { CAP_HEADER + CAP_INDEX, CAPF_ZERO }
+};
+#endif
+
+#ifdef RF_SNAPSHOT
+volatile unsigned char SnapSeq; /* Timer_A runs - interrupt only */
+struct Snap SnapOut;            /* Copy being sent (SnapSend) */
+unsigned char SnapSent;         /* Bytes of SnapOut sent */
+#endif
+
+#ifdef RF_TXSLOT
+unsigned char TxQueue[TX_SIZE]; /* Characters to send */
+unsigned char TxHead;           /* Next to write - main loop only */
+volatile unsigned char TxTail;  /* Next to send - interrupt only */
+unsigned short TxShift;         /* Bits left of the byte, next in bit 0 */
+unsigned char TxBits;           /* Bits left, 0 = idle */
+unsigned char TxTicks;          /* Ticks to the next bit */
+unsigned char TxFrac;           /* Bit time fraction - 1/256 tick */
+#endif
+
+/*
+ *  Main entry file
+ */
+void main(void)
+{
+  WDTCTL = WDTPW + WDTHOLD;             // Stop watchdog timer
+
+  Init(); 
+
+  for(;;)
+  {
+     /*
+      *  Sleep until an interrupt posts an event.
+      *  The interrupts are disabled while checking the queue, so an event
+      *  posted after the check is not lost : the sleep and the interrupt
+      *  enable are the same instruction, and the interrupt wakes up the CPU.
+      */
+     _BIC_SR(GIE);
+     if(EvTail == EvHead)
+        __low_power_mode_0();           /* LPM0_bits + GIE */
+     _BIS_SR(GIE);
+
+     /*
+      *  Run the handlers to completion, one event at time
+      */
+     while(EvTail != EvHead)
+     {
+        Dispatch(EvQueue[EvTail]);
+        EvTail = (EvTail + 1) & (EVQ_SIZE - 1);
+     }
+  }
+}
+
+/**
+ * Dispatch
+ * @brief Deliver an event to the handlers
+ *
+ * @param event event from the queue
+ * @return None
+ */
+void Dispatch(unsigned char event)
+{
+   switch(event)
+   {
+      case EV_RFON:
+      case EV_RFOFF:
+      case EV_RFTIMER:
+         RfConfirm(event);
+         break;
+
+      case EV_BUTTON:
+         CmdPost(SRC_BUTTON, CMD_TOGGLE);
+         break;
+
+      case EV_STEP:
+         Motion(event);
+#ifdef RF_SCRIPT
+         ScriptRun();
+#endif
+         CmdNext();
+         break;
+
+#ifdef RF_CAPTURE
+      case EV_CAPTURE:
+         CaptureDump();
+         break;
+#endif
+#ifdef RF_TXSLOT
+      case EV_TXDONE:
+#ifdef RF_CAPTURE
+         if(CapState == CAP_FROZEN)
+            CaptureDump();
+#endif
+#ifdef RF_SNAPSHOT
+         SnapSend();
+#endif
+         break;
+#endif
+#ifdef RF_SNAPSHOT
+      case EV_SNAPSHOT:
+         if(SnapSent == SNAP_SIZE && SnapRead(&SnapOut))
+         {
+            SnapSent = 0;       /* Else still sending, or skipped */
+            SnapSend();
+         }
+         break;
+#endif
+#ifdef RF_RCINPUT
+      case EV_RCPULSE:
+         RcMap();
+         break;
+#endif
+#ifdef RF_IRINPUT
+      case EV_IRCODE:
+         IrCommand();
+         break;
+#endif
+#ifdef RF_PACKET
+      case EV_PACKET:
+         PktCommand();
+         break;
+#endif
+#ifdef RF_GOERTZEL
+      case EV_SAMPLES:
+         GzRun();
+         break;
+#endif
+   }
+}
+
+/**
+ * FsmStep
+ * @brief Run a transition of a table driven state machine
+ *
+ * @param trans table entry for the current state and the event
+ * @param state current state
+ * @return The next state
+ */
+unsigned char FsmStep(const struct FsmTrans *trans, unsigned char state)
+{
+   unsigned char next;
+
+   next = trans->next[trans->action ? trans->action() : 0];
+   return(next == FSM_STAY ? state : next);
+}
+
+/**
+ * RfConfirm
+ * @brief Validation for RF command
+ *
+ * The RF detection assume a ON condition if the signal is correctly received
+ * for at least VALIDATE_RF ms. Then waits that the signal cease before to
+ * assume is ended. At the end of the cycle detection the system ignore any
+ * activity for IGNORE_RF ms.<br>
+ * With RF_GESTURE, after a press the next one is awaited GESTURE_GAP ms and
+ * confirmed in the same way, the command is posted at the end of the
+ * gesture.<br>
+ * With RF_HOLD the move starts once the press is confirmed and is stopped
+ * when the signal is lost, then the next press is awaited at once.<br>
+ * With RF_LINKQ the press ends after LINK_WAITEND ms without signal and
+ * is checked by LinkCheck.<br>
+ * EV_RFON comes for every valid period of the signal, EV_RFOFF when the
+ * signal is lost, EV_RFTIMER when RfLongDelay expires.<br>
+ * The sequence is a coroutine (see CO_BEGIN) : every wait returns, the next
+ * event resumes it from the same point.
+ *
+ * @param event EV_RFON, EV_RFOFF or EV_RFTIMER
+ * @return None
+ */
+void RfConfirm(unsigned char event)
+{
+   /*
+    *  A timer event queued before RfLongDelay was reloaded is stale
+    */
+   if(event == EV_RFTIMER && RfLongDelay)
+      return;
+
+#ifdef RF_LINKQ
+   if(event == EV_RFON)
+      LinkSeen++;
+#endif
+
+   CO_BEGIN(RfConfirmLc);
+   for(;;)
+   {
+      /*
+       *  Detecting a valid receiving command, only if the servomotor is
+       *  not moving
+       */
+      RF_AWAIT_EVENT(RfDetected && Pwm1_State == POSIT);
+
+      /*
+       *  Verify that the signal persist VALIDATE_RF ms
+       */
+      RF_AWAIT_MS(VALIDATE_RF, event == EV_RFOFF);
+      if(event == EV_RFOFF)
+         continue;
+
+#if defined(RF_HOLD)
+      /*
+       *  Hold : move away from the end where the arm stays, otherwise the
+       *  other way of the last press
+       */
+      if(Pwm1_dc >= POSIT_START)
+         RfHoldCmd = CMD_DOWN;
+      else if(Pwm1_dc <= POSIT_END)
+         RfHoldCmd = CMD_UP;
+      else
+         RfHoldCmd = (RfHoldCmd == CMD_UP) ? CMD_DOWN : CMD_UP;
+      CmdPost(SRC_RF, RfHoldCmd);
+
+      /*
+       *  Stop at the first period lost, wherever the arm is
+       */
+      LED_ON;
+      RF_AWAIT_EVENT(!RfDetected);
+      LED_OFF;
+      CmdPost(SRC_RF, CMD_STOP);
+      continue;
+#elif defined(RF_GESTURE)
+      /*
+       *  Gesture : count the presses until a pause longer than
+       *  GESTURE_GAP, GESTURE_MAX presses or a long press
+       */
+      RfPresses = 0;
+      for(;;)
+      {
+         LED_ON;
+         RfPressStart = CmdClock;
+         LINK_START;
+         do
+            RF_AWAIT_MS(RF_WAITEND, TRUE);
+         while(event != EV_RFTIMER || RfDetected);
+         LED_OFF;
+         if(!LINK_OK(RF_WAITEND))
+         {
+            RfPresses = 0;              /* Failsafe taken, no command */
+            break;
+         }
+
+         if((unsigned short)(CmdClock - RfPressStart) >= GESTURE_LONG)
+         {
+            RfPresses = GESTURE_HOLD;
+            break;
+         }
+         if(++RfPresses == GESTURE_MAX)
+            break;
+
+         RF_AWAIT_MS(GESTURE_GAP, RfDetected);
+         if(!RfDetected)
+            break;                      /* Pause - gesture ended */
+         RF_AWAIT_MS(VALIDATE_RF, event == EV_RFOFF);
+         if(event == EV_RFOFF)
+            break;
+      }
+      if(RfPresses)
+         CmdPost(SRC_RF, GestureCmd[RfPresses - 1]);
+#else
+      /*
+       *  RF command detected ! Notify that, then wait the signal to cease :
+       *  every period received, or lost, starts the wait end again
+       */
+      LED_ON;
+      LINK_START;
+      do
+         RF_AWAIT_MS(RF_WAITEND, TRUE);
+      while(event != EV_RFTIMER || RfDetected);
+
+      /*
+       *  RF command ceased ! Start the movement, if the link was good
+       */
+      LED_OFF;
+      if(LINK_OK(RF_WAITEND))
+         CmdPost(SRC_RF, CMD_TOGGLE);
+#endif
+
+      /*
+       *  Then ignore for a while
+       */
+      RF_AWAIT_MS(IGNORE_RF, FALSE);
+   }
+   CO_END(RfConfirmLc);
+}
+
+#ifdef RF_LINKQ
+/**
+ * LinkCheck
+ * @brief RF link quality of the session just ended, failsafe
+ *
+ * The periods expected are the session length, without the final wait,
+ * over the period of the tone received (device or broadcast tone). A
+ * session with less than LINK_MINPCT % of them is degraded : the arm is
+ * stopped and, with LINK_PARK, moved to POSIT_START.
+ *
+ * @param tail ms at the end of the session without signal (the wait end)
+ * @return TRUE if the link was good, FALSE if the failsafe was taken
+ */
+unsigned char LinkCheck(unsigned short tail)
+{
+   unsigned short elapsed = CmdClock - LinkStamp;
+   unsigned short half;
+
+   elapsed = (elapsed > tail) ? elapsed - tail : 0;
+   half = LinkBcast ? TONE_BCAST_US :
+                      (RfToneMin + RfToneMax) / 2 * RF_SAMPLE_US;
+
+   /*
+    *  A period is 2 * half us
+    */
+   LinkExpected = (unsigned short) (((unsigned long) elapsed * 500) / half);
+   if(LinkSeen >= LinkExpected)
+      LinkQuality = 100;
+   else
+      LinkQuality = (unsigned char)
+                    (((unsigned long) LinkSeen * 100) / LinkExpected);
+
+   if(LinkQuality >= LINK_MINPCT)
+      return(TRUE);
+
+   LinkBad++;
+   CmdPost(SRC_RF, CMD_STOP);
+#if LINK_FAILSAFE == LINK_PARK
+   CmdPost(SRC_RF, CMD_UP);
+#endif
+   return(FALSE);
+}
+#endif
+
+/**
+ * Motion
+ * @brief Arm movement
+ *
+ * A move added to an empty queue starts the movement, the step timer keeps
+ * the engine running until the queue is empty (see MotionFsm).
+ *
+ * @param event EV_MOVE (from MovePost) or EV_STEP (Pwm1_delay expired)
+ * @return None
+ */
+void Motion(unsigned char event)
+{
+   if(Pwm1_State >= MOTION_STATES)
+      Pwm1_State = POSIT;
+
+   FSM_DISPATCH(MotionFsm, Pwm1_State, event - EV_STEP);
+}
+
+/**
+ * CmdPost
+ * @brief Command arbiter
+ *
+ * Every command source posts here (main loop only).
+ * A STOP empties the queue and stops the arm at once, whatever the source,
+ * and the next command of its source is never taken for a repeat.
+ * A RF command resumes the motion script waiting in OP_WAITRF.
+ * The other commands are dropped if the same source sent the same command
+ * less than CMD_WINDOW ms ago (i.e. the RF remote kept pressed), or if the
+ * same command is already waiting. The queue is kept in priority order :
+ * when full, the command of lowest priority is lost.
+ *
+ * @param source SRC_RF, SRC_SERIAL, SRC_BUTTON or SRC_IR
+ * @param cmd CMD_xxx
+ * @return None
+ */
+void CmdPost(unsigned char source, unsigned char cmd)
+{
+   unsigned char prio = CmdPriority[source];
+   unsigned char i;
+
+   if(cmd == CMD_STOP)
+   {
+      CmdLast[source] = 0;      /* None */
+      CmdCount   = 0;
+      MoveCount  = 0;
+      MoveDwell  = 0;
+      Pwm1_delay = 0;
+      Pwm1_reach = Pwm1_dc;
+      Pwm1_State = POSIT;
+#ifdef RF_AXIS2
+      Pwm2_reach = Pwm2_dc;
+      DdaLeft    = 0;
+#endif
+#ifdef RF_SCRIPT
+      ScriptState = SCRIPT_IDLE;
+#endif
+      return;
+   }
+
+#ifdef RF_SCRIPT
+#ifdef RF_IRINPUT
+   if((source == SRC_RF || source == SRC_IR) &&
+      ScriptState == SCRIPT_WAITRF)
+#else
+   if(source == SRC_RF && ScriptState == SCRIPT_WAITRF)
+#endif
+   {
+      /*
+       *  The remote resumes the script
+       */
+      ScriptState = SCRIPT_RUN;
+      ScriptRun();
+      return;
+   }
+#endif
+
+   if(cmd == CmdLast[source] &&
+      (unsigned short)(CmdClock - CmdStamp[source]) < CMD_WINDOW)
+      return;
+
+   for(i = 0; i < CmdCount; i++)
+      if((CmdQueue[i] & 0x0F) == cmd)
+         return;
+
+   CmdLast[source]  = cmd;
+   CmdStamp[source] = CmdClock;
+
+   /*
+    *  Find the place, after the commands of the same or higher priority
+    */
+   for(i = 0; i < CmdCount; i++)
+      if(CmdPriority[CmdQueue[i] >> 4] < prio)
+         break;
+
+   if(CmdCount == CMDQ_SIZE)
+   {
+      if(i == CMDQ_SIZE)
+         return;                 /* Lowest priority and no room */
+      CmdCount--;                /* Lose the last one */
+   }
+
+   memmove(&CmdQueue[i + 1], &CmdQueue[i], CmdCount - i);
+   CmdQueue[i] = (source << 4) | cmd;
+   CmdCount++;
+
+   CmdNext();
+}
+
+/**
+ * CmdNext
+ * @brief Start the first command of the queue, if the arm is in position
+ *
+ * The command becomes a move at the default speed.
+ *
+ * @param none
+ * @return None
+ */
+void CmdNext(void)
+{
+   unsigned char cmd;
+   unsigned char target;
+
+   if(Pwm1_State != POSIT || !CmdCount)
+      return;
+
+   cmd = CmdQueue[0] & 0x0F;
+   CmdCount--;
+   memmove(&CmdQueue[0], &CmdQueue[1], CmdCount);
+
+#ifdef RF_SCRIPT
+   if(cmd == CMD_SCRIPT)
+   {
+      ScriptState = SCRIPT_RUN;
+      ScriptPc    = 0;
+      ScriptLoop  = 0;
+      ScriptRun();
+      return;
+   }
+#endif
+
+   /*
+    *  Assign the reaching goal
+    */
+   if(cmd >= CMD_PRESET)
+     target = Preset[cmd - CMD_PRESET];
+   else if(cmd == CMD_UP)
+     target = POSIT_START;
+   else if(cmd == CMD_DOWN)
+     target = POSIT_END;
+   else if(Pwm1_dc == POSIT_START)
+   {
+     target = POSIT_END;
+   }
+   else if(Pwm1_dc < POSIT_START)
+   {
+     target = POSIT_START;
+   }
+   else
+   {
+      if(Pwm1_dc == POSIT_END)
+      {
+        target = POSIT_START;
+      }
+      else
+      {
+        target = POSIT_END;
+      }
+   }
+
+   MovePost(target, SPEED / PRESCALER, 0);
+}
+
+/**
+ * MovePost
+ * @brief Add a move to the queue (main loop only)
+ *
+ * If the arm is in position the move starts at once.
+ *
+ * @param target Pwm1_dc to reach
+ * @param speed ms per step
+ * @param dwell time to stop at the target - DWELL_TICK units
+ * @return FALSE if the queue is full
+ */
+unsigned char MovePost(unsigned char target, unsigned char speed,
+                       unsigned char dwell)
+{
+   struct Move *move;
+
+   if(MoveCount == MOVEQ_SIZE)
+      return(FALSE);
+
+   move = &MoveQueue[(MoveHead + MoveCount) & (MOVEQ_SIZE - 1)];
+   move->target = target;
+   move->speed  = speed;
+   move->dwell  = dwell;
+#ifdef RF_AXIS2
+   move->target2 = MoveTarget2;   /* Set by MovePost2 */
+   MoveTarget2   = AXIS_HOLD;
+#endif
+   MoveCount++;
+
+   Motion(EV_MOVE);
+   return(TRUE);
+}
+
+#ifdef RF_AXIS2
+/**
+ * MovePost2
+ * @brief Add a coordinated move of both axes to the queue (main loop only)
+ *
+ * @param target Pwm1_dc to reach
+ * @param target2 Pwm2_dc to reach, AXIS_HOLD to leave the axis 2 still
+ * @param speed ms per step of the axis with the longest way
+ * @param dwell time to stop at the target - DWELL_TICK units
+ * @return FALSE if the queue is full
+ */
+unsigned char MovePost2(unsigned char target, unsigned char target2,
+                        unsigned char speed, unsigned char dwell)
+{
+   MoveTarget2 = target2;
+   if(!MovePost(target, speed, dwell))
+   {
+      MoveTarget2 = AXIS_HOLD;
+      return(FALSE);
+   }
+   return(TRUE);
+}
+#endif
+
+/**
+ * MotionStep
+ * @brief Arm movement action - move the arm of one step toward Pwm1_reach
+ *
+ * When the target is reached and the dwell expired, the next move of the
+ * queue is taken in the same step, so the step timing does not change
+ * between two moves.<br>
+ * With RF_AXIS2 the move lasts the steps of the longest way, every axis
+ * steps when its interpolation error overflows (Bresenham), so the cost
+ * is the same at every step.
+ *
+ * @param none
+ * @return The branch : 0 in position, 1 moving up, 2 moving down
+ */
+unsigned char MotionStep(void)
+{
+   struct Move *move;
+#ifdef RF_AXIS2
+   unsigned char branch;
+#endif
+
+   while(MOVE_DONE)
+   {
+      if(MoveDwell)
+      {
+         /*
+          *  Dwelling - the arm is still busy
+          */
+         MoveDwell--;
+         Pwm1_delay = DWELL_TICK;
+         return(Pwm1_State == POSIT ? WAITINGUP : Pwm1_State);
+      }
+
+      if(!MoveCount)
+         return(POSIT);
+
+      move       = &MoveQueue[MoveHead];
+      Pwm1_reach = move->target;
+      MoveSpeed  = move->speed;
+      MoveDwell  = move->dwell;
+      MoveHead   = (MoveHead + 1) & (MOVEQ_SIZE - 1);
+      MoveCount--;
+#ifdef RF_AXIS2
+      if(move->target2 != AXIS_HOLD)
+         Pwm2_reach = move->target2;
+
+      DdaDelta[0] = Pwm1_reach > Pwm1_dc ? Pwm1_reach - Pwm1_dc
+                                         : Pwm1_dc - Pwm1_reach;
+      DdaDelta[1] = Pwm2_reach > Pwm2_dc ? Pwm2_reach - Pwm2_dc
+                                         : Pwm2_dc - Pwm2_reach;
+      DdaSteps    = DdaDelta[0] > DdaDelta[1] ? DdaDelta[0] : DdaDelta[1];
+      DdaLeft     = DdaSteps;
+      DdaErr[0]   = DdaSteps >> 1;
+      DdaErr[1]   = DdaSteps >> 1;
+#endif
+   }
+
+   Pwm1_delay = MoveSpeed * PRESCALER;
+#ifdef RF_AXIS2
+   branch = Pwm1_reach >= Pwm1_dc ? WAITINGUP : WAITINGDOWN;
+   DdaLeft--;
+   DdaStep(&Pwm1_dc, Pwm1_reach, 0);
+   DdaStep(&Pwm2_dc, Pwm2_reach, 1);
+   return(branch);
+#else
+   if(Pwm1_reach > Pwm1_dc)
+   {
+      Pwm1_dc++;
+      return(WAITINGUP);
+   }
+
+   Pwm1_dc--;
+   return(WAITINGDOWN);
+#endif
+}
+
+#ifdef RF_AXIS2
+/**
+ * DdaStep
+ * @brief Interpolate an axis of the running move
+ *
+ * @param dc duty cycle of the axis
+ * @param reach position to reach
+ * @param axis 0 or 1
+ * @return None
+ */
+void DdaStep(unsigned short *dc, unsigned short reach, unsigned char axis)
+{
+   DdaErr[axis] += DdaDelta[axis];
+   if(DdaErr[axis] < DdaSteps)
+      return;
+
+   DdaErr[axis] -= DdaSteps;
+   if(reach > *dc)
+      (*dc)++;
+   else
+      (*dc)--;
+}
+#endif
+
+#ifdef RF_SCRIPT
+/**
+ * ScriptRun
+ * @brief Motion script interpreter
+ *
+ * Runs the operations of Script while there is room in the move queue,
+ * at most SCRIPT_OPS at every call, so a script without moves in a loop
+ * cannot lock the main loop. It is called at every step, and when the
+ * remote resumes the script.
+ * OP_WAIT is a move to the last target with a dwell.
+ *
+ * @param none
+ * @return None
+ */
+void ScriptRun(void)
+{
+   const unsigned char *op;
+   unsigned char n;
+
+   for(n = 0; n < SCRIPT_OPS; n++)
+   {
+      if(ScriptState != SCRIPT_RUN || MoveCount == MOVEQ_SIZE)
+         return;
+
+      op = &Script[ScriptPc];
+      switch(op[0])
+      {
+         case OP_MOVE:
+            ScriptTarget = op[1];
+            ScriptSpeed  = op[2];
+            MovePost(ScriptTarget, ScriptSpeed, 0);
+            ScriptPc += 3;
+            break;
+
+         case OP_MOVE2:
+            ScriptTarget = op[1];
+            ScriptSpeed  = op[3];
+#ifdef RF_AXIS2
+            MovePost2(ScriptTarget, op[2], ScriptSpeed, 0);
+#else
+            MovePost(ScriptTarget, ScriptSpeed, 0);
+#endif
+            ScriptPc += 4;
+            break;
+
+         case OP_SLIDE:
+            ScriptTarget += op[1];      /* Signed, modulo 256 */
+            MovePost(ScriptTarget, ScriptSpeed, 0);
+            ScriptPc += 2;
+            break;
+
+         case OP_WAIT:
+            MovePost(ScriptTarget, 1, op[1]);
+            ScriptPc += 2;
+            break;
+
+         case OP_LOOP:
+            if(!ScriptLoop)
+               ScriptLoop = op[1];      /* First pass */
+            if(!op[1] || --ScriptLoop)
+               ScriptPc = op[2];
+            else
+               ScriptPc += 3;
+            break;
+
+         case OP_WAITRF:
+            ScriptState = SCRIPT_WAITRF;
+            ScriptPc++;
+            break;
+
+         case OP_END:
+         default:
+            ScriptState = SCRIPT_IDLE;
+            break;
+      }
+   }
+}
+#endif
+
+#ifdef RF_RCINPUT
+/**
+ * RcMap
+ * @brief Map the last RC pulse on the arm position
+ *
+ * The pulses out of RC_PULSEMIN .. RC_PULSEMAX are noise and ignored.
+ * Inside the deadband the pulse is the stick center, so the arm does not
+ * wander with a released stick. Out of the curve span the pulse is
+ * clipped, inside it is interpolated between two points of RcCurve.
+ * The arm is moved only if no move is running (button, script, RF), and
+ * only for changes over RC_HYST, to hide the jitter of the measure.
+ *
+ * @param none
+ * @return None
+ */
+void RcMap(void)
+{
+   unsigned short width = RcWidth;
+   unsigned char seg;
+   unsigned char frac;
+   short dc;
+
+   if(width < RC_PULSEMIN || width > RC_PULSEMAX)
+      return;
+
+   if(width >= RC_CENTER - RC_DEADBAND && width <= RC_CENTER + RC_DEADBAND)
+      width = RC_CENTER;
+
+   if(width < RC_MIN)
+      width = RC_MIN;
+   width -= RC_MIN;
+   if(width > (RC_SEGMENTS << RC_SEGSHIFT))
+      width = RC_SEGMENTS << RC_SEGSHIFT;
+
+   seg  = width >> RC_SEGSHIFT;
+   frac = width & ((1 << RC_SEGSHIFT) - 1);
+   dc   = RcCurve[seg];
+   if(frac)
+      dc += ((short) RcCurve[seg + 1] - dc) * frac >> RC_SEGSHIFT;
+
+   if(Pwm1_State != POSIT)
+      return;
+   if(dc <= (short) Pwm1_dc + RC_HYST && dc >= (short) Pwm1_dc - RC_HYST)
+      return;
+
+   Pwm1_dc    = dc;               /* Single word write, no lock needed */
+   Pwm1_reach = dc;
+}
+#endif
+
+#ifdef RF_IRINPUT
+/**
+ * IrEdge
+ * @brief IR decoder - handle an edge of P1.6
+ *
+ * Called by the P1.6 interrupt, level is the P1.6 level after the edge :
+ * the time from the previous edge is the length of a mark (rise) or of a
+ * space (fall), see EdgeTicks.
+ * The first mark tells the protocol : the 9 ms NEC leader, else the first
+ * half bit of RC-5. NEC sends 32 bits (LSB first) : address, its inverse
+ * (or the extended address), command and its inverse, the bit is in the
+ * space length. RC-5 is Manchester coded, decoded by Rc5Trans.
+ * A decoded frame is stored in IrProto, IrAddr, IrCmd, IrToggle and
+ * EV_IRCODE is posted. On a bad timing the frame is dropped, and a falling
+ * edge can be the start of the next one.
+ *
+ * @param level P1.6 level (BIT6 = high)
+ * @return None
+ */
+void IrEdge(unsigned char level)
+{
+   unsigned short ticks;
+   unsigned char ev;
+   unsigned char next;
+
+   ticks = EdgeTicks();
+
+   if(IrState == IR_MARK && level)
+   {
+      if(ticks >= IR_NEC_LEADMIN && ticks <= IR_NEC_LEADMAX)
+      {
+         IrState = IR_NEC_LEAD;
+         return;
+      }
+      IrState = IR_RC5 + RC5_MID1;     /* Mark in the middle of S1 */
+      IrBits  = RC5_BITS - 1;
+      IrData  = 1;
+   }
+
+   switch(IrState)
+   {
+      case IR_NEC_LEAD:
+         if(ticks >= IR_NEC_HDRMIN && ticks <= IR_NEC_HDRMAX)
+         {
+            IrState = IR_NEC_BITS;
+            IrBits  = 0;
+            return;
+         }
+         break;                         /* Repeat frame or noise */
+
+      case IR_NEC_BITS:
+         if(ticks >= IR_NEC_BITMIN && ticks <= IR_NEC_BITMAX)
+            ev = 0;
+         else if(!level && ticks >= IR_NEC_ONEMIN && ticks <= IR_NEC_ONEMAX)
+            ev = 1;
+         else
+            break;
+         if(level)
+            return;                     /* Mark */
+
+         IrData >>= 1;
+         if(ev)
+            IrData |= 0x80000000UL;
+         if(++IrBits < 32)
+            return;
+
+         if((unsigned char)(IrData >> 24) == (unsigned char) ~(IrData >> 16))
+         {
+            IrProto = IR_NEC;
+            IrAddr  = (unsigned char) IrData;
+            IrCmd   = (unsigned char)(IrData >> 16);
+            EvPost(EV_IRCODE);
+         }
+         IrState = IR_IDLE;
+         return;
+
+      default:
+         if(IrState < IR_RC5)
+            break;
+
+         if(ticks >= IR_RC5_SHORTMIN && ticks <= IR_RC5_SHORTMAX)
+            ev = 0;
+         else if(ticks >= IR_RC5_LONGMIN && ticks <= IR_RC5_LONGMAX)
+            ev = 4;
+         else
+            break;
+         if(level)
+            ev += 2;                    /* A mark ended */
+
+         next = (Rc5Trans[IrState - IR_RC5] >> ev) & 3;
+         if(next == IrState - IR_RC5)
+            break;
+         IrState = IR_RC5 + next;
+         if(next != RC5_MID0 && next != RC5_MID1)
+            return;
+
+         IrData = (IrData << 1) | (next == RC5_MID1);
+         if(--IrBits)
+            return;
+
+         IrProto  = IR_RC5PROTO;
+         IrAddr   = (IrData >> 6) & 0x1F;
+         IrCmd    = (IrData & 0x3F) | ((IrData & 0x1000) ? 0 : 0x40);
+         IrToggle = (IrData >> 11) & 1;
+         EvPost(EV_IRCODE);
+         IrState = IR_IDLE;
+         return;
+   }
+
+   /*
+    *  Idle or bad timing - a mark can start a frame
+    */
+   IrState = level ? IR_IDLE : IR_MARK;
+}
+
+/**
+ * IrCommand
+ * @brief Post the command of the IR key received
+ *
+ * A RC-5 frame with the same toggle bit of the last one used is the key
+ * kept pressed, so it is ignored. The unknown keys are ignored.
+ *
+ * @param none
+ * @return None
+ */
+void IrCommand(void)
+{
+   unsigned char i;
+
+   if(IrProto == IR_RC5PROTO)
+   {
+      if(IrToggle == IrLastToggle)
+         return;
+      IrLastToggle = IrToggle;
+   }
+
+   for(i = 0; i < IR_KEYS; i++)
+      if(IrKeys[i].proto == IrProto && IrKeys[i].addr == IrAddr &&
+         IrKeys[i].code == IrCmd)
+      {
+         CmdPost(SRC_IR, IrKeys[i].cmd);
+         return;
+      }
+}
+#endif
+
+#ifdef RF_PACKET
+/**
+ * PktEdge
+ * @brief Packet receiver - handle an edge of P1.6
+ *
+ * Called by the P1.6 interrupt, level is the P1.6 level after the edge :
+ * the time from the previous edge (EdgeTicks) is the length of a high
+ * (fall) or of a low (rise) of the receiver output.
+ * In PKT_HUNT the edges of the preamble are counted, the sync low after
+ * at least PKT_PREAMBLE of them starts the bits. The bit is read at its
+ * fall, from the length of the high part. The three bytes of a complete
+ * packet are stored in PktAddr, PktCmd, PktCrc and EV_PACKET is posted :
+ * the CRC is checked by the main loop. Any bad timing drops the packet.
+ *
+ * @param level P1.6 level (BIT6 = high)
+ * @return None
+ */
+void PktEdge(unsigned char level)
+{
+   unsigned short ticks = EdgeTicks();
+
+   if(PktState == PKT_HUNT)
+   {
+      if(ticks >= PKT_PREMIN && ticks <= PKT_PREMAX)
+      {
+         if(PktBits < PKT_PREAMBLE)
+            PktBits++;
+      }
+      else if(level && PktBits == PKT_PREAMBLE &&
+              ticks >= PKT_SYNCMIN && ticks <= PKT_SYNCMAX)
+      {
+         PktState = PKT_DATA;
+         PktBits  = 0;
+      }
+      else
+         PktBits = 0;
+      return;
+   }
+
+   if(ticks < PKT_BITMIN || ticks > PKT_BITMAX)
+   {
+      PktState = PKT_HUNT;
+      PktBits  = 0;
+      return;
+   }
+   if(level)
+      return;                           /* Low part */
 
+   PktData <<= 1;
+   if(ticks >= PKT_BITSPLIT)
+      PktData |= 1;
+   if(++PktBits < PKT_BITS)
+      return;
 
-unsigned char Command;          /* Equivalent to the pushbutton */
+   PktAddr  = (unsigned char)(PktData >> 16);
+   PktCmd   = (unsigned char)(PktData >> 8);
+   PktCrc   = (unsigned char) PktData;
+   EvPost(EV_PACKET);
+   PktState = PKT_HUNT;
+   PktBits  = 0;
+}
 
-/*
- *  Main entry file
+/**
+ * PktCommand
+ * @brief Post the command of the packet received
+ *
+ * The packets with a bad CRC, for another device or with an unknown
+ * command are ignored.
+ *
+ * @param none
+ * @return None
  */
-void main(void)
+void PktCommand(void)
 {
-  WDTCTL = WDTPW + WDTHOLD;             // Stop watchdog timer
+   unsigned char cmd = PktCmd;
 
-  Init(); 
+   if(PktCrc8(PktCrc8(0, PktAddr), cmd) != PktCrc)
+      return;
+   if(PktAddr != RfAddr && PktAddr != PKT_BROADCAST)
+      return;
+   if((cmd < CMD_TOGGLE || cmd > CMD_STOP) &&
+      (cmd < CMD_PRESET || cmd >= CMD_PRESET + PRESETS))
+      return;
 
-  for(;;)
-  {
-     /*
-      *  Validation for RF command.
-      *
-      *  States (at the start the state is the POSIT)
-      *    IDLE - detecting a valid receiving command 
-      *    VALIDATE - verify a valid signal if persist for 5 ms
-      *    WAITDETEND - waiting for the detect command to expire
-      *    IGNORE - ignore any activity for a specified time
-      *
-      *  The RF detection assume a ON condition if the signal is correctly received
-      *  for at least 5 ms. Then waits that the signal cease before to assume is ended.
-      *  At the end of the cycle detection the system ignore any activity for at least 100 ms
-      */
-     switch(RfDetConfirmSt)
-     {
-        case IDLE:
-           if(RfDetected && Pwm1_State == POSIT)
-           {
-              RfLongDelay = VALIDATE_RF;
-              RfDetConfirmSt = VALIDATE;
-           }   
-           break;
+   CmdPost(SRC_RF, cmd);
+}
+#endif
 
-        case VALIDATE:
-           if(RfDetected)
-           {
-              if(!RfLongDelay)
-              {
-                 /*
-                  *  RF command detected !
-                  *  Notify that, then load the counter for the wait end
-                  */
-                 LED_ON;
-                 RfLongDelay = WAITEND_RF;
-                 RfDetConfirmSt = WAITDETEND;
-              }
-           }
-           else
-              RfDetConfirmSt = IDLE;
-           break;
-           
-        case WAITDETEND:   
-           if(!RfDetected)
-           {
-              if(!RfLongDelay)
-              {
-                 /*
-                  *  RF command ceased !
-                  *  Notify that, then load the counter for the ignore state
-                  */
-                 LED_OFF;
-                 Command = TRUE;
-                 RfDetConfirmSt = IGNORE;
-                 RfLongDelay = IGNORE_RF;  /* Reload timer */
-              }
-           }
-           else
-              RfLongDelay = WAITEND_RF;  /* Reload timer */
-           
-           break;
+#ifdef RF_EDGETIME
+/**
+ * EdgeTicks
+ * @brief Time from the previous edge of P1.6 - .01 ms
+ *
+ * Called by the P1.6 interrupt at every edge. The edges are timestamped
+ * with Pwm1_cn, that wraps every PWM period, and with CmdClock : if more
+ * than EDGE_GAP ms passed, the time is 0xFFFF (too long for any decoder).
+ * Pwm1_cn can be one tick late if the timer interrupt is pending.
+ * The time of the edge is taken by Port1_isr at its entry (EdgeNow), so
+ * it is right also when the decoder is preempted (RF_NESTED).
+ *
+ * @param none
+ * @return ticks from the previous edge
+ */
+unsigned short EdgeTicks(void)
+{
+   unsigned short ticks;
 
-        case IGNORE:   
-           if(!RfLongDelay)
-           {
-              RfDetConfirmSt = IDLE;
-              Command = FALSE;
-           }
-           break;
-           
-        default:
-          RfShortDelay   = 0;
-          RfLongDelay    = 0;
-          RfDetConfirmSt = IDLE;
-          break;
-     }   
+   ticks = EdgeNow - EdgeStamp;
+   if(EdgeNow < EdgeStamp)
+      ticks += PWM1_MAXSTEP + 1;
+   if((unsigned short)(EdgeNowClock - EdgeClock) >= EDGE_GAP)
+      ticks = 0xFFFF;
+   EdgeStamp = EdgeNow;
+   EdgeClock = EdgeNowClock;
+   return(ticks);
+}
+#endif
 
-     /*
-      *  The pushbutton or RF trigger the arm movement - other states keep the engine running
-      *
-      *  States (at the start the state is the POSIT)
-      *    POSIT  - pressing the pushbutton the servo is positioned on one of the two work positions - with delay
-      *    MOVINGUP - the duty cycle is increasing
-      *    MOVINGDOWN - the dutycycle is decreasing
-      *    WAITINGUP - wait for moving up
-      *    WAITINDOWN - wait for moving down
-      */
-     if(testButton(S2_BUTTON) || \
-        Command == TRUE || \
-        Pwm1_State == MOVINGUP || \
-        Pwm1_State == MOVINGDOWN || \
-        Pwm1_State == WAITINGUP || \
-        Pwm1_State == WAITINGDOWN )    /* Check S2 pushbutton */
-     {
-        /*
-         *  Button pressed
-         */
-        switch(Pwm1_State)
-        {
-           default:
-           case POSIT:
-              Command = FALSE;    /* Reset the RF command */
-              /*
-               *  Assign the reaching goal and the direction (increment
-               *  or decrement)
-               */
-              if(Pwm1_dc == POSIT_START)
-              {
-                Pwm1_reach = POSIT_END;
-              }
-              else if(Pwm1_dc < POSIT_START)
-              {
-                Pwm1_reach = POSIT_START;
-              }
-              else if(Pwm1_dc > POSIT_START)
-              {
-                 if(Pwm1_dc == POSIT_END)
-                 {
-                   Pwm1_reach = POSIT_START;
-                 }   
-                 else if(Pwm1_dc > POSIT_END)
-                 {
-                   Pwm1_reach = POSIT_END;
-                 }   
-                 else if(Pwm1_dc < POSIT_END)
-                 {
-                   Pwm1_reach = POSIT_END;
-                 }
-              }
+/**
+ * EvPost
+ * @brief Post an event in the queue
+ *
+ * Called only under interrupt. The interrupts do not nest, so the
+ * interrupt routines are the only writers of EvHead and the main loop the
+ * only writer of EvTail, no lock is needed. With RF_NESTED the P1.6
+ * decoders can be preempted by Timer_A, so the interrupts are disabled
+ * while posting.
+ * If the queue is full the event is lost.
+ * The interrupt routine posting must wake up the main loop on exit
+ * (EVWAKE).
+ *
+ * @param event event to post
+ * @return None
+ */
+void EvPost(unsigned char event)
+{
+   unsigned char head;
+#ifdef RF_NESTED
+   istate_t state = __get_interrupt_state();
 
-              if(Pwm1_reach > Pwm1_dc)
-                 Pwm1_State = MOVINGUP;
-              else
-                 Pwm1_State = MOVINGDOWN;
-              break;
+   __disable_interrupt();
+#endif
 
-           case MOVINGUP:      
-              if(Pwm1_dc == Pwm1_reach)
-              {
-                Command = FALSE;    /* Reset the RF command */
-                Pwm1_State = POSIT;
-              }  
-              else
-              {  
-                Pwm1_State = WAITINGUP;
-                Pwm1_delay = SPEED;
-                Pwm1_dc++;
-              }  
-              break;
-
-           case MOVINGDOWN:              
-              if(Pwm1_dc == Pwm1_reach)
-              {
-                Command = FALSE;    /* Reset the RF command */
-                Pwm1_State = POSIT;
-              }  
-              else
-              {  
-                Pwm1_State = WAITINGDOWN;
-                Pwm1_delay = SPEED;
-                Pwm1_dc--;
-              }  
-              break;             
-
-           case WAITINGUP:              
-              if(Pwm1_delay == 0)
-                Pwm1_State = MOVINGUP;
-              break;             
-
-           case WAITINGDOWN:              
-              if(Pwm1_delay == 0)
-                Pwm1_State = MOVINGDOWN;
-              break;             
-        }
-     }   
-  }
+   head = (EvHead + 1) & (EVQ_SIZE - 1);
+   if(head != EvTail)
+   {
+      EvQueue[EvHead] = event;
+      EvHead = head;
+   }
+
+#ifdef RF_NESTED
+   __set_interrupt_state(state);
+#endif
 }
 
 /*
@@ -368,8 +2244,13 @@ void Init(void)
   P2DIR  = 0x00;              /* Leave P2.6 and P2.7 in input direction */
 
   P1REN |= BIT6;              /* Enable Pull-up/Down resistor on P1.6 - P1OUT is 0 so is a pull-down */
+#ifdef RF_ADDR_STRAP
+  P2REN |= BIT7;              /* P2.7 pull-down, the strap pulls it high */
+#endif
   P1IES &= ~BIT6;             /* Set P1.6 interrupt generation on the low-to-high transition */  
+#ifndef RF_GOERTZEL
   P1IE |= BIT6;               /* Enable interrupt on P1.6 */
+#endif
   /*
    *  Set variables
    */
@@ -380,13 +2261,116 @@ void Init(void)
 
   RfDetState     = IDLE;
   RfDetCounter   = 0;
-  RfDetConfirmSt = IDLE;
+  RfAddr         = DEVICE_ADDR;
+#ifdef RF_ADDR_STRAP
+  __delay_cycles(160);        /* 10 us, the P2.7 pull-down settles */
+  if(P2IN & BIT7)
+    RfAddr++;
+#endif
+#ifdef RF_HOLD
+  RfHoldCmd      = CMD_UP;
+#endif
+#ifdef RF_LINKQ
+  LinkQuality    = 100;
+  LinkBad        = 0;
+#endif
+  RfToneMax      = TONE_HALF_US(RfAddr) / RF_SAMPLE_US;
+  RfToneMin      = RfToneMax - RfToneMax / 16;
+  RfToneMax     += RfToneMax / 16;
+#ifdef RF_GOERTZEL
+  GzTaken        = 0;
+  GzCount        = 0;
+  GzCoeff        = GzCoeffs[RfAddr];
+  GzS1           = 0;
+  GzS2           = 0;
+  GzB1           = 0;
+  GzB2           = 0;
+#endif
+  RfConfirmLc    = 0;
   RfDetected     = FALSE;
   RfPrescaler    = PRESCALER;
-  RfShortDelay   = 0;
   RfLongDelay    = 0;
   
-  Command = FALSE;
+  EvHead         = 0;
+  EvTail         = 0;
+  ButtonDelay    = 0;
+
+#ifdef RF_RCINPUT
+  RcRise         = 0;
+  RcWidth        = RC_CENTER;
+#endif
+
+#ifdef RF_IRINPUT
+  P1OUT         |= BIT6;             /* P1.6 pull-up, the IR receiver idles high */
+  P1IES         |= BIT6;             /* Wait the first mark */
+  IrState        = IR_IDLE;
+  IrLastToggle   = 0xFF;
+#endif
+
+#ifdef RF_PACKET
+  PktState       = PKT_HUNT;
+  PktBits        = 0;
+#endif
+
+#ifdef RF_EDGETIME
+  EdgeStamp      = 0;
+  EdgeClock      = 0;
+#endif
+
+  CmdCount       = 0;
+  CmdClock       = 0;
+  memset(CmdLast, 0, sizeof(CmdLast));
+
+  MoveHead       = 0;
+  MoveCount      = 0;
+  MoveSpeed      = SPEED / PRESCALER;
+  MoveDwell      = 0;
+
+#ifdef RF_AXIS2
+  Pwm2_dc        = PWMINITIALVALUE;
+  Pwm2_reach     = PWMINITIALVALUE;
+  MoveTarget2    = AXIS_HOLD;
+  DdaLeft        = 0;
+#endif
+
+#ifdef RF_SCRIPT
+  ScriptState    = SCRIPT_RUN;
+  ScriptPc       = 0;
+  ScriptLoop     = 0;
+  ScriptTarget   = PWMINITIALVALUE;
+  ScriptSpeed    = SPEED / PRESCALER;
+  ScriptRun();
+#endif
+
+  P2IES &= ~BIT6;             /* S2 pushbutton interrupt on press (low-to-high) */
+  P2IFG &= ~BIT6;
+  P2IE  |= BIT6;
+
+#ifdef RF_SNAPSHOT
+  SnapSeq   = 0;
+  SnapSent  = SNAP_SIZE;
+#endif
+
+#ifdef RF_TXSLOT
+  P1OUT |= BIT5;              /* Serial TX idle */
+  TxHead    = 0;
+  TxTail    = 0;
+  TxBits    = 0;
+  TxFrac    = 0;
+#endif
+
+#ifdef RF_CAPTURE
+  P1OUT |= BIT5;              /* Serial TX idle */
+  CapHead   = 0;
+  CapTail   = 0;
+  CapUsed   = 0;
+  CapEvents = 0;
+  CapLevel  = 0;
+  CapFirst  = 0;
+  CapState  = CAP_RUN;
+  CapDelta  = 0;
+  CapSent   = 0;
+#endif
   
   /*
    *  Set Timer
@@ -401,46 +2385,321 @@ void Init(void)
   _BIS_SR(GIE);               /* Enable interrupt */
 }
 
+#ifdef RF_GOERTZEL
+/*
+ *  Power of a Goertzel bin : s1^2 + s2^2 - coeff * s1 * s2
+ */
+static unsigned long GzBinPower(short s1, short s2, short coeff)
+{
+   return((long) s1 * s1 + (long) s2 * s2 -
+          (((long) coeff * s1) >> 14) * s2);
+}
+
+/**
+ * GzRun
+ * @brief Goertzel tone detector, 16 samples of P1.6
+ *
+ * Every sample is +/- GZ_AMPL, so the filter state stays in 16 bits
+ * (about 5500 at most with a block of 100). At the end of every block the
+ * power of the device and broadcast bins is checked against GZ_THRESHOLD :
+ * RfDetected is set as the half period detector does, and RfConfirm gets
+ * EV_RFON for every block with the tone, EV_RFOFF when it is lost.
+ *
+ * @param none
+ * @return None
+ */
+void GzRun(void)
+{
+   unsigned short bits = GzBlock;
+   unsigned long power;
+   unsigned char i;
+   short x;
+   short s;
+
+   for(i = 0; i < 16; i++)
+   {
+      x = (bits & 0x8000) ? GZ_AMPL : -GZ_AMPL;
+      bits <<= 1;
+
+      s = x + (short) (((long) GzCoeff * GzS1) >> 14) - GzS2;
+      GzS2 = GzS1;
+      GzS1 = s;
+      s = x + (short) (((long) GZ_BCAST_COEFF * GzB1) >> 14) - GzB2;
+      GzB2 = GzB1;
+      GzB1 = s;
+
+      if(++GzCount < GZ_N)
+         continue;
+
+      /*
+       *  End of the block
+       */
+      GzPower = GzBinPower(GzS1, GzS2, GzCoeff);
+      power = GzBinPower(GzB1, GzB2, GZ_BCAST_COEFF);
+      if(power > GzPower)
+         GzPower = power;
+      GzCount = 0;
+      GzS1 = 0;
+      GzS2 = 0;
+      GzB1 = 0;
+      GzB2 = 0;
+
+      if(GzPower >= GZ_THRESHOLD)
+      {
+         RfDetected = TRUE;
+         RfConfirm(EV_RFON);
+      }
+      else if(RfDetected)
+      {
+         RfDetected = FALSE;
+         RfConfirm(EV_RFOFF);
+      }
+   }
+}
+#endif
+
+#ifdef RF_CAPTURE
 /**
- * testButton
- * @brief Checking the pushbutton status
- *
- * The function is reading a pushbutton and return it's status.
- * Just to avoid multiple readings, the function is returning TRUE
- * (i.e. pushbutton pressed) only if detect a transition from true to
- *  false, with at least some tick delay.
- *  In other words is reading the pushbutton and IF the reading is
- *  high (pushbutton pressed), is waiting for the reading to return false
- *  and then report TRUE.
- *  Primitive but for test purpose is enough.
- *
- * @param button button to be checked. 0 -> S1  1 -> S2
- * @return True if button is pressed, False if not pressed
- */
-unsigned char testButton(unsigned char button)
-{
-   unsigned char retvalue = 0;
-   unsigned char smallDelay = 0;
-   
-   retvalue = P2IN & (0x80 >> button);
-   
-   if(retvalue)
+ * CaptureEdge
+ * @brief Store an edge of P1.6 in the capture ring
+ *
+ * Called by the timer interrupt.
+ * The edge is stored as a varint (7 bits per byte, bit 7 set if more bytes
+ * follow) of (CapDelta << 3), the channel 0 in the low 3 bits.
+ * If the ring is full the oldest edges are dropped : the delta of the
+ * first one kept is from the edge before it, the start of the dump.
+ * The varint is written in the ring directly, no buffer on the stack.
+ * After the trigger, CAPTURE_POST edges are stored then the ring is frozen.
+ *
+ * @param none
+ * @return None
+ */
+void CaptureEdge(void)
+{
+   unsigned long value = CapDelta << 3;
+   unsigned long rest;
+   unsigned char len = 1;
+   unsigned char byte;
+
+   CapDelta = 0;
+   for(rest = value >> 7; rest; rest >>= 7)
+      len++;
+
+   while(CAPTURE_SIZE - CapUsed < len)
    {
-      for (smallDelay=200; smallDelay>0; smallDelay--);
-           
-      retvalue = P2IN & (0x80 >> button);
-      if(retvalue)
+      /*
+       *  Drop the oldest edge
+       */
+      do
       {
-         while(retvalue)
-            retvalue = P2IN & (0x80 >> button);
-         return(TRUE);    
+         byte = CapRing[CapTail];
+         if(++CapTail == CAPTURE_SIZE)
+            CapTail = 0;
+         CapUsed--;
       }
-      else
-        return(FALSE);
+      while(byte & 0x80);
+      CapFirst ^= 1;
+      CapEvents--;
    }
-   else
-      return (FALSE);
+
+   do
+   {
+      byte = value & 0x7F;
+      value >>= 7;
+      if(value)
+         byte |= 0x80;
+      CapRing[CapHead] = byte;
+      if(++CapHead == CAPTURE_SIZE)
+         CapHead = 0;
+   }
+   while(value);
+   CapUsed += len;
+   CapEvents++;
+
+   if(CapState == CAP_TRIGGER && !--CapPost)
+   {
+      CapState = CAP_FROZEN;
+      EvPost(EV_CAPTURE);
+   }
+}
+
+/*
+ *  Byte of the capture dump at pos
+ */
+static unsigned char CapByte(unsigned char pos)
+{
+   unsigned long value;
+   unsigned char i;
+
+   if(pos >= CAP_HEADER)
+   {
+      if(pos - CAP_HEADER < CapUsed)
+         return(CapRing[(CapTail + pos - CAP_HEADER) % CAPTURE_SIZE]);
+      pos -= CapUsed;
+   }
+
+   for(i = 0; CapFields[i + 1][0] <= pos; i++)
+      ;
+   pos -= CapFields[i][0];
+   if(pos >= sizeof(value))
+      return(0);
+
+   switch(CapFields[i][1])
+   {
+      case CAPF_ONE:    value = 1;                     break;
+      case CAPF_MAGIC:  value = 0x52544652L;           break; /* "RFTR" */
+      case CAPF_EVENTS: value = CapEvents;             break;
+      case CAPF_TICK:   value = 10000;                 break;
+      case CAPF_INDEX:  value = CAP_HEADER + CapUsed;  break;
+      case CAPF_PIN:    value = 0x16;                  break;
+      case CAPF_FIRST:  value = CapFirst;              break;
+      case CAPF_HEADER: value = CAP_HEADER;            break;
+      default:          value = 0;                     break;
+   }
+   return((unsigned char) (value >> (8 * pos)));
+}
+
+/**
+ * CaptureDump
+ * @brief Send the frozen capture ring on the serial, then restart it
+ *
+ * The ring is sent as a complete trace file (see SW/Host/rftrace.h) :
+ * header, channel table (P1.6 only), a single block with the ring content
+ * and the block index, byte by byte from CapByte.
+ * The interrupts are disabled while sending, the software serial needs
+ * exact timings, so the PWM is stopped for the time of the dump
+ * (about 50 ms at 9600 baud). With RF_TXSLOT the bytes are sent by Timer_A
+ * in the PWM gaps, with the interrupts on : the dump goes on from CapSent
+ * as long as the TX queue takes the bytes, then again at every EV_TXDONE,
+ * it never waits.
+ * The ring records again at once, but only the next press triggers it
+ * (CAP_SENT until the RF is lost), so a press is dumped once.
+ *
+ * @param none
+ * @return None
+ */
+void CaptureDump(void)
+{
+   unsigned char size = CAP_HEADER + CapUsed + CAP_INDEX;
+
+#ifdef RF_TXSLOT
+   while(CapSent < size && TxPut(CapByte(CapSent)))
+      CapSent++;
+   if(CapSent < size)
+      return;                   /* The rest at the next EV_TXDONE */
+#else
+   _BIC_SR(GIE);
+   for(CapSent = 0; CapSent < size; CapSent++)
+      putch(CapByte(CapSent));
+#endif
+
+   /*
+    *  Restart the capture
+    */
+   CapHead   = 0;
+   CapTail   = 0;
+   CapUsed   = 0;
+   CapEvents = 0;
+   CapDelta  = 0;
+   CapSent   = 0;
+   CapFirst  = CapLevel ? 1 : 0;
+   CapState  = CAP_SENT;
+
+#ifndef RF_TXSLOT
+   _BIS_SR(GIE);
+#endif
+}
+#endif
+
+#ifdef RF_SNAPSHOT
+/**
+ * SnapRead
+ * @brief Consistent copy of the Timer_A state (main loop only)
+ *
+ * The fields are copied again until Timer_A did not run meanwhile
+ * (SnapSeq unchanged). Timer_A does not nest, so the main loop never sees
+ * it in the middle and one count per run is enough. How often Timer_A
+ * lands in a copy depends on its own length, so the tries are bounded
+ * (SNAP_TRIES) : the main loop never spins on it.
+ * The fields are read as volatile : the compiler keeps the reads between
+ * the two of SnapSeq and does them again at every try.
+ *
+ * @param snap the copy
+ * @return TRUE if the copy is consistent
+ */
+unsigned char SnapRead(struct Snap *snap)
+{
+   unsigned char seq;
+   unsigned char tries = SNAP_TRIES;
+
+   do
+   {
+      if(!tries--)
+         return(FALSE);
+      seq = SnapSeq;
+      snap->pwm_cn     = *(volatile unsigned short *) &Pwm1_cn;
+      snap->pwm_delay  = *(volatile unsigned short *) &Pwm1_delay;
+      snap->long_delay = *(volatile unsigned short *) &RfLongDelay;
+      snap->clock      = *(volatile unsigned short *) &CmdClock;
+      snap->detected   = *(volatile unsigned char *) &RfDetected;
+   } while(seq != SnapSeq);
+   return(TRUE);
+}
+
+/**
+ * SnapSend
+ * @brief Send SnapOut on the serial (telemetry)
+ *
+ * The fields low byte first, SNAP_SIZE bytes. The record goes on from
+ * SnapSent as long as the TX queue takes the bytes, then again at every
+ * EV_TXDONE, it never waits.
+ *
+ * @param none
+ * @return None
+ */
+void SnapSend(void)
+{
+   unsigned short value;
+
+   while(SnapSent < SNAP_SIZE)
+   {
+      switch(SnapSent >> 1)
+      {
+         case 0:  value = SnapOut.pwm_cn;     break;
+         case 1:  value = SnapOut.pwm_delay;  break;
+         case 2:  value = SnapOut.long_delay; break;
+         case 3:  value = SnapOut.clock;      break;
+         default: value = SnapOut.detected;   break;
+      }
+      if(!TxPut((char) (SnapSent & 1 ? value >> 8 : value)))
+         return;
+      SnapSent++;
+   }
+}
+#endif
+
+#ifdef RF_TXSLOT
+/**
+ * TxPut
+ * @brief Queue a character for the serial TX (main loop only)
+ *
+ * Timer_A posts EV_TXDONE when it takes the last character of the queue.
+ *
+ * @param c character to send
+ * @return FALSE if the queue is full
+ */
+unsigned char TxPut(char c)
+{
+   unsigned char head = (TxHead + 1) & (TX_SIZE - 1);
+
+   if(head == TxTail)
+      return(FALSE);
+
+   TxQueue[TxHead] = c;
+   TxHead = head;
+   return(TRUE);
 }
+#endif
 
 /**
  * Timer_A
@@ -459,10 +2718,12 @@ unsigned char testButton(unsigned char button)
 #pragma vector=TIMERA0_VECTOR
 __interrupt void Timer_A( void )
 {
-   if(Pwm1_State == POSIT)
+   if(RF_DETRUN && RF_DETSLOT)
    {  
       /*
-       *  RF detection only if the servomotor is not moving
+       *  RF detection only if the servomotor is not moving (RF_HOLD : also
+       *  while moving, to stop it at the release), in the sampling slot
+       *  (RF_DECIM)
        *  This parts works together with the I/O interrupt in order to
        *  recognize a specific incoming frequency
        */
@@ -478,67 +2739,61 @@ __interrupt void Timer_A( void )
 
          case DETHIGH:
             /* 
-             *  Verify that the signal stays high at least COUNTHIGH reads
-             *  (minus COUNTOLER reads)
+             *  Count the high half period until the fall, then check it
+             *  (RF_HALF_VALID) : a too long one is not a tone
              */
             TEST_ON;
-            if(P1IN & BIT6)
+            if((P1IN & BIT6) && RfDetCounter < RF_HALFMAX)
+               RfDetCounter++;
+            else if(!(P1IN & BIT6) && RF_HALF_VALID(RfDetCounter))
             {
-               if(RfDetCounter < COUNTHIGH)
-                  RfDetCounter++;
-               else
-               {
-                  RfDetState = DETLOW;
-                  RfDetCounter = 0;
-               }   
-            }  
+               RfDetState = DETLOW;
+               RfDetCounter = 0;
+            }
             else
             {
-               if(RfDetCounter >= (COUNTHIGH - COUNTOLER))
-               {
-                 RfDetState = DETLOW;
-                 RfDetCounter = 0;
-               }
-               else
-               {
-                 RfDetState = DETEND;
-                 RfDetected = FALSE;
-               }  
+               RfDetState = DETEND;
+               if(RfDetected)
+                 EvPost(EV_RFOFF);
+               RfDetected = FALSE;
+               CAP_REARM;
             }
             TEST_OFF;
             break;
 
          case DETLOW:
             /* 
-             *  Verify that the signal stays low at least COUNTLOW reads
-             *  (minus COUNTOLER reads)
+             *  Count the low half period until the rise, then check it :
+             *  a valid period is received
              */
            TEST_ON;
-           if(!(P1IN & BIT6))
+           if(!(P1IN & BIT6) && RfDetCounter < RF_HALFMAX)
+              RfDetCounter++;
+           else if((P1IN & BIT6) && RF_HALF_VALID(RfDetCounter))
            {
-              if(RfDetCounter < COUNTLOW)
-                 RfDetCounter++;
-              else
+              RfDetState = DETEND;
+#ifdef RF_LINKQ
+              LinkBcast = (RfDetCounter >= RF_BCASTMIN);
+#endif
+              RfDetCounter = 0;
+              RfDetected = TRUE;
+              EvPost(EV_RFON);
+#ifdef RF_CAPTURE
+              if(CapState == CAP_RUN)
               {
-                 RfDetState = DETEND;
-                 RfDetCounter = 0;
-                 RfDetected = TRUE;
-              }   
-            }  
-            else
-            {
-               if(RfDetCounter >= (COUNTLOW - COUNTOLER))
-               {
-                 RfDetState = DETEND;
-                 RfDetCounter = 0;
-                 RfDetected = TRUE;
-               }
-               else
-               {
-                  RfDetState = DETEND;
-                  RfDetected = FALSE;
-               }   
-            }
+                 CapState = CAP_TRIGGER;
+                 CapPost  = CAPTURE_POST;
+              }
+#endif
+           }
+           else
+           {
+              RfDetState = DETEND;
+              if(RfDetected)
+                EvPost(EV_RFOFF);
+              RfDetected = FALSE;
+              CAP_REARM;
+           }
            TEST_OFF;
            break;
         case DETEND:
@@ -555,19 +2810,33 @@ __interrupt void Timer_A( void )
    }
 
 
+#ifdef RF_CAPTURE
+  /*
+   *  Capture - P1.6 sampled every tick, so also the edges coming while
+   *  the P1.6 interrupt is disabled are seen
+   */
+  if(CapState != CAP_FROZEN)
+  {
+     CapDelta++;
+     if((P1IN & BIT6) != CapLevel)
+     {
+        CapLevel ^= BIT6;
+        CaptureEdge();
+     }
+  }
+#endif
+
   /*
    *  Delay management
    *  This counter is used in the states WAITUP and WAITDOWN in order to
    *  create a delay in the PWM generation
    */
   if(Pwm1_delay)
+  {
     Pwm1_delay--;
-
-  /*
-   *  Delay management for detection confirmation
-   */
-  if(RfShortDelay)
-    RfShortDelay--;
+    if(!Pwm1_delay)
+      EvPost(EV_STEP);
+  }
 
   /*
    *  Prescaler management for long delays
@@ -577,8 +2846,48 @@ __interrupt void Timer_A( void )
   else
   {
     RfPrescaler = PRESCALER;
+    CmdClock++;
+#ifdef RF_SNAPSHOT
+    if(!(CmdClock & (SNAP_PERIOD - 1)))
+      EvPost(EV_SNAPSHOT);
+#endif
     if(RfLongDelay)
+    {
       RfLongDelay--;
+      if(!RfLongDelay)
+        EvPost(EV_RFTIMER);
+    }
+
+    if(ButtonDelay)
+    {
+      ButtonDelay--;
+      if(!ButtonDelay)
+      {
+        /*
+         *  Debounce expired - wait for the next change of S2
+         */
+        if(P2IN & BIT6)
+          P2IES |= BIT6;
+        else
+          P2IES &= ~BIT6;
+        P2IFG &= ~BIT6;
+        P2IE  |= BIT6;
+      }
+    }
+
+#ifdef RF_GOERTZEL
+    /*
+     *  Goertzel detector - P1.6 sampled every ms, 16 samples at a time
+     *  to the main loop
+     */
+    GzBits = (GzBits << 1) | ((P1IN & BIT6) ? 1 : 0);
+    if(++GzTaken == 16)
+    {
+      GzTaken = 0;
+      GzBlock = GzBits;
+      EvPost(EV_SAMPLES);
+    }
+#endif
   }  
   
   /*
@@ -592,6 +2901,12 @@ __interrupt void Timer_A( void )
       PWM1_ON;
     else
       PWM1_OFF;
+#ifdef RF_AXIS2
+    if(Pwm1_cn <= Pwm2_dc)
+      PWM2_ON;
+    else
+      PWM2_OFF;
+#endif
   }  
   else
   {
@@ -601,8 +2916,49 @@ __interrupt void Timer_A( void )
     */   
     Pwm1_cn = 0;
     PWM1_OFF;   
+#ifdef RF_AXIS2
+    PWM2_OFF;
+#endif
   }  
-  
+
+#ifdef RF_TXSLOT
+  /*
+   *  Serial TX - the bit times are TX_BITQ8 / 256 ticks, the fraction is
+   *  carried to the next bit. A byte starts only in the gap slot.
+   */
+  if(TxBits)
+  {
+    if(!--TxTicks)
+    {
+      if(TxShift & 1)
+        P1OUT |= BIT5;
+      else
+        P1OUT &= ~BIT5;
+      TxShift >>= 1;
+      TxBits--;
+      TxFrac += (unsigned char) TX_BITQ8;
+      TxTicks = (TX_BITQ8 >> 8) + (TxFrac < (unsigned char) TX_BITQ8);
+    }
+  }
+  else if(TxTail != TxHead && Pwm1_cn >= PWM1_WINDOW &&
+          Pwm1_cn <= PWM1_MAXSTEP - TX_BYTE_TICKS)
+  {
+    P1OUT &= ~BIT5;                    /* Start bit */
+    TxShift = TxQueue[TxTail] | 0x300; /* Data, stop, idle */
+    TxBits  = 10;
+    TxFrac  = (unsigned char) TX_BITQ8;
+    TxTicks = TX_BITQ8 >> 8;
+    TxTail  = (TxTail + 1) & (TX_SIZE - 1);
+    if(TxTail == TxHead)
+      EvPost(EV_TXDONE);               /* Queue empty (TxPut) */
+  }
+#endif
+
+#ifdef RF_SNAPSHOT
+  SnapSeq++;                  /* The state changed (SnapRead) */
+#endif
+
+  EVWAKE;
 }
 
 /**
@@ -610,6 +2966,13 @@ __interrupt void Timer_A( void )
  * @brief I/O port 1 interrupt service routine
  *
  * This function handle the I/O Port 1 interrupt.
+ * With RF_RCINPUT every edge of P1.6 is timestamped with Pwm1_cn and the
+ * interrupt is moved to the other edge : at the fall the pulse width is
+ * stored in RcWidth and EV_RCPULSE posted. Pwm1_cn can be one tick late
+ * if the timer interrupt is pending, so the width is +/- 1 tick.
+ * With RF_IRINPUT or RF_PACKET every edge of P1.6 goes to the IR decoder
+ * (IrEdge) or to the packet receiver (PktEdge), with RF_NESTED with the
+ * interrupts on (see the header).
  *
  * @param none 
  * @return None
@@ -617,6 +2980,60 @@ __interrupt void Timer_A( void )
 #pragma vector=PORT1_VECTOR
 __interrupt void Port1_isr(void)
 {
+#ifdef RF_RCINPUT
+  unsigned short width;
+
+  if(P1IFG & BIT6)
+  {
+    if(P1IN & BIT6)
+    {
+       RcRise = Pwm1_cn;         /* Rise - wait for the fall */
+       P1IES |= BIT6;
+    }
+    else
+    {
+       width = Pwm1_cn - RcRise;
+       if(Pwm1_cn < RcRise)
+         width += PWM1_MAXSTEP + 1;   /* Pwm1_cn reloaded in the pulse */
+       RcWidth = width;
+       P1IES &= ~BIT6;           /* Fall - wait for the next rise */
+       EvPost(EV_RCPULSE);
+    }
+
+    P1IFG &= ~BIT6;  /* Reset I/O interrupt on P1.6 (also set by P1IES) */
+  }
+
+  EVWAKE;
+#elif defined(RF_EDGETIME)
+  unsigned char level;
+
+  if(P1IFG & BIT6)
+  {
+    level = P1IN & BIT6;
+    if(level)
+      P1IES |= BIT6;            /* Wait the other edge */
+    else
+      P1IES &= ~BIT6;
+    P1IFG &= ~BIT6;  /* Reset I/O interrupt on P1.6 (also set by P1IES) */
+    EdgeNow      = Pwm1_cn;     /* Time of the edge */
+    EdgeNowClock = CmdClock;
+#ifdef RF_NESTED
+    P1IE &= ~BIT6;              /* The next edge waits in P1IFG */
+    _BIS_SR(GIE);               /* Timer_A can preempt the decoder */
+#endif
+#ifdef RF_IRINPUT
+    IrEdge(level);
+#else
+    PktEdge(level);
+#endif
+#ifdef RF_NESTED
+    _BIC_SR(GIE);
+    P1IE |= BIT6;
+#endif
+  }
+
+  EVWAKE;
+#else
   if(P1IFG & BIT6)
   {  
     /*
@@ -627,12 +3044,44 @@ __interrupt void Port1_isr(void)
     {  
        RfDetState = DETHIGH;     /* Change detection state machine */
        RfDetCounter = 0;         /* Reset counter */
+#ifdef RF_DECIM
+       RfDecim = RF_DECIM - 1;   /* First sample RF_DECIM ticks later */
+#endif
        P1IE &= ~BIT6;            /* Disable interrupt */
     }   
 
     P1IFG &= ~BIT6;  /* Reset I/O interrupt on P1.6 */
   }  
+#endif
 } 
+
+/**
+ * I/O Port 2
+ * @brief I/O port 2 interrupt service routine
+ *
+ * This function handle the S2 pushbutton (P2.6).
+ * A press is posted as EV_BUTTON, then the pin is ignored for DEBOUNCE ms.
+ * When the debounce expires the timer interrupt re-enables the pin, waiting
+ * for the release or for the next press.
+ *
+ * @param none
+ * @return None
+ */
+#pragma vector=PORT2_VECTOR
+__interrupt void Port2_isr(void)
+{
+  if(P2IFG & BIT6)
+  {
+    if(!(P2IES & BIT6))
+      EvPost(EV_BUTTON);     /* Low-to-high - pressed */
+
+    P2IE &= ~BIT6;           /* Disable interrupt for the debounce */
+    ButtonDelay = DEBOUNCE;
+    P2IFG &= ~BIT6;          /* Reset I/O interrupt on P2.6 */
+  }
+
+  EVWAKE;
+}
 /*
  *  This code is documented using DoxyGen 
  *  (http://www.stack.nl/~dimitri/doxygen/index.html)
@@ -0,0 +1,85 @@
+/**
+ *  @file rf_packet.h
+ *  @brief RF link packet format and tone addresses, shared by the receiver
+ *  and the transmitters
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details Instead of the single tone, the remote can send a packet of
+ *  3 bytes : address, command and CRC-8. It is received by rf_motor.c
+ *  when RF_PACKET is defined (see PktEdge), sent by the remote rf_remote.c
+ *  (RF_PACKET) and generated on the PC by SW/Host/rftool (rftool packet).
+ *  This header is shared with the host tools, so it must stay plain C
+ *  without any device dependency.
+ *
+ *  The receiver output is high while the carrier is on. A packet is :
+ *
+ *  Preamble   PKT_PREAMBLE square wave periods, PKT_PRE_US high and low,
+ *             to settle the receiver gain
+ *  Sync       PKT_SYNC_US low
+ *  Bits       PKT_BITS bits, MSB first, all of the same length : a 0 is
+ *             PKT_SHORT_US high then PKT_LONG_US low, a 1 is PKT_LONG_US
+ *             high then PKT_SHORT_US low
+ *
+ *  The bytes are the address (PKT_BROADCAST = every device), the command
+ *  (CMD_xxx of rf_motor.c) and the CRC-8 of both, polynomial
+ *  x^8 + x^2 + x + 1 (PKT_CRC_POLY), initial value 0, no reflection, i.e.
+ *  address 0x01, command 0x01 -> CRC 0x12. PktCrc8 below is the only copy
+ *  of the CRC : it is compiled when RF_PACKET is defined before this header
+ *  is included (rf_motor.c, rf_remote.c and the host tools).
+ *  A packet lasts 8 + 3 + 24 * 1.2 = 39.8 ms.
+ *
+ *  Without packets, the device address selects the tone accepted by the
+ *  receiver : TONE_HALF_US(address) is the half period for the addresses
+ *  0 .. TONE_ADDRS - 1, TONE_BCAST_US the one accepted by every device.
+ *
+ *  Address   Tone
+ *  0         80 Hz (the original 555 remote)
+ *  1         100 Hz
+ *  2         120 Hz
+ *  3         140 Hz
+ *  Broadcast 60 Hz
+ */
+#ifndef RF_PACKET_H
+#define RF_PACKET_H
+
+#define PKT_PREAMBLE    8         /* Preamble periods */
+#define PKT_PRE_US      500       /* Preamble half period - us */
+#define PKT_SYNC_US     3000      /* Sync low - us */
+#define PKT_SHORT_US    400       /* Bit, short part - us */
+#define PKT_LONG_US     800       /* Bit, long part - us */
+
+#define PKT_BITS        24
+#define PKT_BROADCAST   0xFF      /* Address of every device */
+#define PKT_CRC_POLY    0x07
+
+#define TONE_ADDRS      4
+#define TONE_HALF_US(a) ((a) == 0 ? 6250 : (a) == 1 ? 5000 : \
+                         (a) == 2 ? 4170 : 3570)
+#define TONE_BCAST_US   8330
+
+#ifdef RF_PACKET
+/**
+ * PktCrc8
+ * @brief CRC-8 of the packet, one byte
+ *
+ * @param crc CRC so far (0 at the start)
+ * @param data next byte
+ * @return the new CRC
+ */
+static unsigned char PktCrc8(unsigned char crc, unsigned char data)
+{
+   unsigned char i;
+
+   crc ^= data;
+   for(i = 0; i < 8; i++)
+   {
+      if(crc & 0x80)
+         crc = (unsigned char) ((crc << 1) ^ PKT_CRC_POLY);
+      else
+         crc <<= 1;
+   }
+   return(crc);
+}
+#endif
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ *  @file rf_remote.c
+ *  @brief Remote control transmitter for the RangeFinder (rf) servo, using
+ *  a MSP430F2012 Texas Instrument microcontroller
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details This code replaces the 555 oscillator of the remote
+ *  (HW/Fidocad/motor_remote.fcd) : the MSP430 drives the data input of the
+ *  TX module and is powered by a coin cell.
+ *
+ *  Version features
+ *  The CPU sleeps in LPM4 (all clocks off, RAM kept, < 0.1 uA) until a key
+ *  is pressed. The key interrupt wakes it up, the signal is generated by
+ *  the Timer_A output unit (TA0 on P1.1, OUTMOD toggle), so the CPU sleeps
+ *  in LPM0 while transmitting, then it goes back to LPM4 when every key is
+ *  released.
+ *
+ *  Tone (default)
+ *  The square wave of REMOTE_ADDR (see rf_packet.h, 80 Hz for the address
+ *  0, 60 Hz for PKT_BROADCAST) is sent while a key is pressed, at least
+ *  TONE_MINTICK watchdog intervals. Any key sends the tone. The timer runs
+ *  in up mode with CCR0 as half period : no interrupt at all.
+ *
+ *  Packets
+ *  Defining RF_PACKET every key sends a packet (see rf_packet.h) with its
+ *  command to REMOTE_ADDR, PKT_REPEAT times. The CCR0 interrupt loads the
+ *  length of the next level at every toggle, the edge itself is made by
+ *  the output unit, so it does not depend on the interrupt latency.
+ *  rf_motor.c must be built with RF_PACKET too.
+ *
+ *  The timer and the watchdog interval run from SMCLK = DCO 1 MHz
+ *  (calibrated), so a timer count is 1 us.
+ *
+ *  Pinout  Mode  Description
+ *  P1.0    Out   Unused (low)
+ *  P1.1    TA0   TX module data
+ *  P1.2    In    Key TOGGLE (pull-up, active low)
+ *  P1.3    In    Key UP
+ *  P1.4    In    Key DOWN
+ *  P1.5    In    Key STOP
+ *  P1.6    Out   Unused (low)
+ *  P1.7    Out   Unused (low)
+ *  P2.6    Out   Unused (low)
+ *  P2.7    Out   Unused (low)
+ *
+ *  Built with IAR Embedded Workbench Version: 3.40A
+ */
+
+#include "msp430x20x2.h"
+
+/*
+ *  Global defines
+ */
+#define KEYS            (BIT2 | BIT3 | BIT4 | BIT5)
+#define KEY_COUNT       4
+
+#define REMOTE_ADDR     0x00     /* Device address (PKT_BROADCAST = all) */
+
+#define TONE_MINTICK    4        /* Minimum tone - watchdog intervals */
+#define QUIET_TICK      2        /* Keys released - watchdog intervals */
+
+//#define RF_PACKET                /* Send packets instead of the tone */
+#define PKT_REPEAT      3        /* Packets sent for every key */
+#define PKT_GAP_US      10000    /* Low between the packets */
+#define PKT_LEAD_US     100      /* From the start to the first edge */
+
+#include "rf_packet.h"              /* After RF_PACKET, for PktCrc8 */
+
+#if REMOTE_ADDR == PKT_BROADCAST
+#define TONE_US         TONE_BCAST_US
+#else
+#define TONE_US         TONE_HALF_US(REMOTE_ADDR)
+#endif
+
+/*
+ *  Commands - CMD_xxx of rf_motor.c
+ */
+#define CMD_TOGGLE      1
+#define CMD_UP          2
+#define CMD_DOWN        3
+#define CMD_STOP        4
+
+/*
+ *  Functions prototype
+ */
+__interrupt void Timer_A0(void);    /* Timer A0 - next packet level */
+__interrupt void Port1_isr(void);   /* Key pressed */
+__interrupt void Wdt_isr(void);     /* Watchdog interval */
+void Init(void);
+void ToneStart(void);
+void TxStop(void);
+void WaitRelease(unsigned char);
+#ifdef RF_PACKET
+void PacketSend(unsigned char);
+#endif
+
+/*
+ *  Global variables
+ */
+unsigned char RemKey;           /* Keys pressed at the wake up */
+unsigned char RemTicks;         /* Watchdog intervals left */
+#ifdef RF_PACKET
+unsigned long RemData;          /* Packet bits */
+unsigned char RemEdge;          /* Edges sent of the packet */
+unsigned char RemRepeat;        /* Packets left */
+#endif
+
+/*
+ *  Key to command, by key bit
+ */
+const unsigned char KeyBit[KEY_COUNT] = { BIT2, BIT3, BIT4, BIT5 };
+const unsigned char KeyCmd[KEY_COUNT] =
+{
+   CMD_TOGGLE, CMD_UP, CMD_DOWN, CMD_STOP
+};
+
+/*
+ *  Main entry file
+ */
+void main(void)
+{
+  Init();
+
+  for(;;)
+  {
+     /*
+      *  Sleep until a key is pressed : only the key interrupt is enabled,
+      *  it disables itself and wakes up the CPU.
+      *  The interrupts are disabled while arming it, so a key coming
+      *  before the sleep is not lost : the sleep and the interrupt enable
+      *  are the same instruction, and the interrupt wakes up the CPU.
+      */
+     _BIC_SR(GIE);
+     RemKey = 0;
+     P1IFG &= ~KEYS;
+     P1IE  |= KEYS;
+     _BIS_SR(LPM4_bits + GIE);
+
+#ifdef RF_PACKET
+     {
+        unsigned char i;
+
+        for(i = 0; i < KEY_COUNT; i++)
+           if(RemKey & KeyBit[i])
+              break;
+        if(i < KEY_COUNT)
+           PacketSend(KeyCmd[i]);
+     }
+     WaitRelease(0);
+#else
+     ToneStart();
+     WaitRelease(TONE_MINTICK);
+     TxStop();
+#endif
+  }
+}
+
+/*
+ *  Init
+ * @brief Init clock, I/O and variables
+ *
+ * @param none
+ * @return None
+ */
+void Init(void)
+{
+  WDTCTL = WDTPW + WDTHOLD;     /* Stop watchdog timer */
+
+  /*
+   *  Set DCO at 1 MHz, SMCLK = DCO
+   */
+  DCOCTL  = CALDCO_1MHZ;
+  BCSCTL1 = CALBC1_1MHZ;
+
+  /*
+   *  Set I/O - every unused pin is an output, so nothing floats and
+   *  draws current in LPM4
+   */
+  P1OUT  = KEYS;              /* Keys pull-up, the rest low */
+  P1DIR  = (unsigned char) ~KEYS;
+  P1REN  = KEYS;
+  P1SEL  = BIT1;              /* P1.1 TA0 output - TX data */
+  P1IES  = KEYS;              /* Key interrupt on press (high-to-low) */
+  P1IFG  = 0;
+
+  P2SEL  = 0;                 /* P2.6 and P2.7 not XIN / XOUT */
+  P2OUT  = 0;
+  P2DIR  = BIT6 | BIT7;
+
+  TACCTL0 = OUTMOD_0;         /* TA0 low (OUT = 0) */
+  TACTL   = TASSEL_2 + TACLR; /* SMCLK, stopped */
+}
+
+/**
+ * ToneStart
+ * @brief Start the tone on TA0
+ *
+ * The output unit toggles TA0 at every CCR0 match, the timer (up mode)
+ * restarts from 0 : no interrupt is needed.
+ *
+ * @param none
+ * @return None
+ */
+void ToneStart(void)
+{
+   TACCR0  = TONE_US - 1;
+   TACCTL0 = OUTMOD_4;            /* Toggle */
+   TACTL   = TASSEL_2 + MC_1 + TACLR;
+}
+
+/**
+ * TxStop
+ * @brief Stop the timer, TA0 low
+ *
+ * @param none
+ * @return None
+ */
+void TxStop(void)
+{
+   TACTL   = TASSEL_2 + TACLR;    /* Stop */
+   TACCTL0 = OUTMOD_0;            /* OUT = 0 */
+}
+
+/**
+ * WaitRelease
+ * @brief Sleep in LPM0 until every key is released
+ *
+ * The watchdog (interval mode, SMCLK / 32768 = 32.8 ms) wakes up the CPU
+ * at every interval. The wait ends after at least min intervals, when the
+ * keys are released for QUIET_TICK intervals, so the bounces of the
+ * release do not wake up the remote again.
+ *
+ * @param min minimum intervals
+ * @return None
+ */
+void WaitRelease(unsigned char min)
+{
+   unsigned char quiet = 0;
+
+   RemTicks = min;
+   WDTCTL = WDT_MDLY_32;
+   IFG1 &= ~WDTIFG;
+   IE1  |= WDTIE;
+
+   while(RemTicks || quiet < QUIET_TICK)
+   {
+      _BIS_SR(LPM0_bits + GIE);   /* Wake up at the next interval */
+      if((P1IN & KEYS) == KEYS)
+         quiet++;
+      else
+         quiet = 0;
+   }
+
+   IE1 &= ~WDTIE;
+   WDTCTL = WDTPW + WDTHOLD;
+}
+
+#ifdef RF_PACKET
+/**
+ * PacketSend
+ * @brief Send PKT_REPEAT packets with a command, then return
+ *
+ * The first toggle of TA0 (rise) comes after PKT_LEAD_US, then the timer
+ * interrupt sets the length of every level. The CPU sleeps in LPM0 until
+ * the interrupt stops the timer.
+ *
+ * @param cmd command
+ * @return None
+ */
+void PacketSend(unsigned char cmd)
+{
+   RemData   = ((unsigned long) REMOTE_ADDR << 16) |
+               ((unsigned short) cmd << 8) |
+               PktCrc8(PktCrc8(0, REMOTE_ADDR), cmd);
+   RemEdge   = 0;
+   RemRepeat = PKT_REPEAT;
+
+   TACCR0  = PKT_LEAD_US - 1;
+   TACCTL0 = OUTMOD_4 + CCIE;     /* Toggle */
+   TACTL   = TASSEL_2 + MC_1 + TACLR;
+
+   _BIC_SR(GIE);
+   while(TACTL & MC_1)
+   {
+      _BIS_SR(LPM0_bits + GIE);
+      _BIC_SR(GIE);
+   }
+   _BIS_SR(GIE);
+}
+
+/**
+ * Timer A0
+ * @brief Timer A0 interrupt service routine - packet levels
+ *
+ * Called at every toggle of TA0 (edge RemEdge, the even ones are rises) :
+ * CCR0 is loaded with the length of the level just started.
+ * The last low of a packet is longer by PKT_GAP_US, the toggle at its end
+ * is the first rise of the next packet. After the last packet TA0 is kept
+ * low (OUTMOD_0) and the next interrupt stops the timer.
+ *
+ * @param none
+ * @return None
+ */
+#pragma vector=TIMERA0_VECTOR
+__interrupt void Timer_A0(void)
+{
+  unsigned char n = RemEdge++;
+  unsigned short t;
+  unsigned char one;
+
+  if(n < 2 * PKT_PREAMBLE - 1)
+    t = PKT_PRE_US;
+  else if(n == 2 * PKT_PREAMBLE - 1)
+    t = PKT_SYNC_US;
+  else if(n < 2 * PKT_PREAMBLE + 2 * PKT_BITS)
+  {
+    /*
+     *  Bit n / 2, MSB first : high part (n even), low part (n odd)
+     */
+    n  -= 2 * PKT_PREAMBLE;
+    one = (RemData >> (PKT_BITS - 1 - (n >> 1))) & 1;
+    t   = (one ^ (n & 1)) ? PKT_LONG_US : PKT_SHORT_US;
+    if(n == 2 * PKT_BITS - 1)
+    {
+      t += PKT_GAP_US;
+      if(--RemRepeat)
+        RemEdge = 0;
+      else
+        TACCTL0 = OUTMOD_0 + CCIE;  /* No more toggles, TA0 low */
+    }
+  }
+  else
+  {
+    TxStop();                   /* Last packet ended */
+    _BIC_SR_IRQ(LPM0_bits);
+    return;
+  }
+
+  TACCR0 = t - 1;
+}
+#endif
+
+/**
+ * I/O Port 1
+ * @brief I/O port 1 interrupt service routine - key pressed
+ *
+ * Stores the keys pressed, disables the key interrupts and wakes up the
+ * main loop from LPM4.
+ *
+ * @param none
+ * @return None
+ */
+#pragma vector=PORT1_VECTOR
+__interrupt void Port1_isr(void)
+{
+  RemKey |= P1IFG & KEYS;
+  P1IE   &= ~KEYS;
+  P1IFG  &= ~KEYS;
+  _BIC_SR_IRQ(LPM4_bits);
+}
+
+/**
+ * Watchdog
+ * @brief Watchdog interval interrupt service routine
+ *
+ * Counts RemTicks and wakes up the main loop from LPM0.
+ *
+ * @param none
+ * @return None
+ */
+#pragma vector=WDT_VECTOR
+__interrupt void Wdt_isr(void)
+{
+  if(RemTicks)
+    RemTicks--;
+  _BIC_SR_IRQ(LPM0_bits);
+}
@@ -0,0 +1,59 @@
+/**
+ *  @file rf_script.h
+ *  @brief Motion script bytecode for rf_motor.c
+ *  @author Stefano B.
+ *  @version 01 beta
+ *  @details A motion script is a byte array in flash, run by the
+ *  interpreter in rf_motor.c (see ScriptRun) when RF_SCRIPT is defined.
+ *  Every operation is an opcode followed by its arguments, one byte each.
+ *  This header is shared with the host tools, so it must stay plain C
+ *  without any device dependency.
+ *
+ *  Opcode      Arguments        Description
+ *  OP_END                       End of the script, the arm stays where it is
+ *  OP_MOVE     target, speed    Move to target (Pwm1_dc) at speed ms per step
+ *  OP_MOVE2    target, target2, Move both axes (RF_AXIS2) arriving together,
+ *              speed            speed is for the longest way. Without
+ *                               RF_AXIS2 target2 is ignored.
+ *  OP_SLIDE    delta            Move of delta steps (signed) from the last
+ *                               target, at the speed of the last move
+ *  OP_WAIT     time             Stay still time * 10 ms (max 2.55 s)
+ *  OP_LOOP     count, at        Run again from the offset at, count times in
+ *                               all (count 0 = forever). Only one counted
+ *                               loop can run at a time.
+ *  OP_WAITRF                    Wait for a RF command, then go on
+ *
+ *  The SC_xxx macros write the operations in a C array, i.e. :
+ *
+ *  const unsigned char Script[] =
+ *  {
+ *     SC_MOVE(78, 10),          offset 0
+ *     SC_WAIT(100),             offset 3
+ *     SC_MOVE(161, 30),         offset 5
+ *     SC_LOOP(0, 0)             offset 8
+ *  };
+ *
+ *  SW/Host/rfchoreo builds the script from a keyframe file.
+ */
+#ifndef RF_SCRIPT_H
+#define RF_SCRIPT_H
+
+#define OP_END        0
+#define OP_MOVE       1
+#define OP_WAIT       2
+#define OP_LOOP       3
+#define OP_WAITRF     4
+#define OP_SLIDE      5
+#define OP_MOVE2      6
+
+#define SC_END              OP_END
+#define SC_MOVE(t, s)       OP_MOVE, (t), (s)
+#define SC_WAIT(t)          OP_WAIT, (t)
+#define SC_LOOP(n, at)      OP_LOOP, (n), (at)
+#define SC_WAITRF           OP_WAITRF
+#define SC_SLIDE(d)         OP_SLIDE, (unsigned char) (d)
+#define SC_MOVE2(t, t2, s)  OP_MOVE2, (t), (t2), (s)
+
+#define SCRIPT_MAXSIZE      256     /* The offsets are one byte */
+
+#endif